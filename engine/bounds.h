@@ -0,0 +1,117 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/// Axis aligned bounding box
+struct AABB
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+    /// @return false if nothing has been added to the box
+    bool valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
+    glm::vec3 centre() const { return (min + max) * 0.5f; }
+    glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+    void expand(const glm::vec3& p) {
+      min = glm::min(min, p);
+      max = glm::max(max, p);
+    }
+
+    void expand(const AABB& b) {
+      if( !b.valid() ) return;
+      min = glm::min(min, b.min);
+      max = glm::max(max, b.max);
+    }
+
+    /// @return The box enclosing this one after transformation
+    AABB transformed(const glm::mat4& m) const {
+      if( !valid() ) return *this;
+      // Transform the centre, and project the extents onto each axis
+      auto c = glm::vec3(m * glm::vec4(centre(), 1.f));
+      auto e = extents();
+      glm::vec3 r(
+        std::abs(m[0][0]) * e.x + std::abs(m[1][0]) * e.y + std::abs(m[2][0]) * e.z,
+        std::abs(m[0][1]) * e.x + std::abs(m[1][1]) * e.y + std::abs(m[2][1]) * e.z,
+        std::abs(m[0][2]) * e.x + std::abs(m[1][2]) * e.y + std::abs(m[2][2]) * e.z);
+      AABB result;
+      result.min = c - r;
+      result.max = c + r;
+      return result;
+    }
+};
+
+/// Bounding sphere
+struct Sphere
+{
+    glm::vec3 centre = {0.f,0.f,0.f};
+    float radius = 0.f;
+};
+
+/**
+ * View frustum, as 6 planes extracted from a view-projection matrix
+ * Planes point inwards, and assume a depth range of 0 -> 1 (GLM_FORCE_DEPTH_ZERO_TO_ONE)
+ */
+struct Frustum
+{
+    enum class Result {
+      Outside,
+      Intersects,
+      Inside,
+    };
+
+    Frustum() = default;
+    Frustum(const glm::mat4& viewProj) {
+      auto row = [&](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+      planes[0] = row(3) + row(0); // Left
+      planes[1] = row(3) - row(0); // Right
+      planes[2] = row(3) + row(1); // Bottom
+      planes[3] = row(3) - row(1); // Top
+      planes[4] = row(2);          // Near
+      planes[5] = row(3) - row(2); // Far
+      for( auto& p : planes ) p /= glm::length(glm::vec3(p));
+    }
+
+    /// Test a world space box against the frustum
+    Result test(const AABB& b) const {
+      auto c = b.centre();
+      auto e = b.extents();
+      auto result = Result::Inside;
+      for( auto& p : planes ) {
+        auto n = glm::vec3(p);
+        auto d = glm::dot(n, c) + p.w;
+        auto r = glm::dot(glm::abs(n), e);
+        if( d < -r ) return Result::Outside;
+        if( d < r ) result = Result::Intersects;
+      }
+      return result;
+    }
+
+    /// Test a world space sphere against the frustum
+    Result test(const Sphere& s) const {
+      auto result = Result::Inside;
+      for( auto& p : planes ) {
+        auto d = glm::dot(glm::vec3(p), s.centre) + p.w;
+        if( d < -s.radius ) return Result::Outside;
+        if( d < s.radius ) result = Result::Intersects;
+      }
+      return result;
+    }
+
+    glm::vec4 planes[6];
+};
+
+#endif
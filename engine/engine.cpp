@@ -9,8 +9,9 @@
 #include "renderer.h"
 #include "node.h"
 
-Engine::Engine()
-  : mRend(new Renderer(*this))
+Engine::Engine(bool headless)
+  : mJobs(new JobSystem())
+  , mRend(new Renderer(*this, headless))
   , mNodeGraph(new Node())
   , mQuit(false)
 {}
@@ -22,6 +23,10 @@ void Engine::run() {
 
   mNodeGraph->init(*mRend.get());
   mNodeGraph->upload(*mRend.get());
+  // Geometry is staged in batches, submit whatever's left over
+  mRend->flushUploads();
+
+  if( mRenderMode == RenderMode::Threaded ) mRend->startRenderThread();
 
   mTimeStart = std::chrono::high_resolution_clock::now();
   mTimeCurrent = mTimeStart;
@@ -58,17 +63,26 @@ void Engine::loop() {
       // Renderer or other events may have asked us to stop rendering
       if (mQuit) break;
 
+      // Calculate the matrices of any nodes in the transform store
+      // Before the update traversal, so node bounds match the rendered matrices.
+      // Changes made by update scripts will apply next frame
+      mTransforms.update(deltaT);
+
       // Perform the update traversal
-      mNodeGraph->update(*this, deltaT);
+      if( mUpdateMode == UpdateMode::Parallel ) mNodeGraph->updateParallel(*this, deltaT, *mJobs.get());
+      else mNodeGraph->update(*this, deltaT);
 
       // Start the frame (Let the renderer reset what it needs)
       mRend->frameStart();
 
-      // Render the scene
-      mNodeGraph->render(*mRend.get(), mCamera.mViewMatrix, mCamera.mProjectionMatrix);
+      // Render the scene, culling subtrees in parallel if they're updated in parallel
+      if( mUpdateMode == UpdateMode::Parallel ) mNodeGraph->renderParallel(*mRend.get(), mCamera.mViewMatrix, mCamera.mProjectionMatrix, *mJobs.get());
+      else mNodeGraph->render(*mRend.get(), mCamera.mViewMatrix, mCamera.mProjectionMatrix);
 
       // Finish the frame, renderer sends commands to gpu here
+      // If threaded the frame is handed to the render thread, while we move on to the next update
       mRend->frameEnd();
+      mFrameCount++;
     }
     catch (...) {
       // Something went wrong, we don't know what but
@@ -81,12 +95,19 @@ void Engine::loop() {
 }
 
 void Engine::cleanup() {
+  mRend->stopRenderThread();
   mRend->waitIdle();
   mNodeGraph->cleanup(*mRend.get());
   mRend->cleanup();
 }
 
 Camera& Engine::camera() { return mCamera; }
+TransformStore& Engine::transforms() { return mTransforms; }
+JobSystem& Engine::jobs() { return *mJobs.get(); }
+void Engine::updateMode(UpdateMode mode) { mUpdateMode = mode; }
+Engine::UpdateMode Engine::updateMode() const { return mUpdateMode; }
+void Engine::renderMode(RenderMode mode) { mRenderMode = mode; }
+Engine::RenderMode Engine::renderMode() const { return mRenderMode; }
 float Engine::windowWidth() const { return static_cast<float>(mRend->windowWidth()); }
 float Engine::windowHeight() const { return static_cast<float>(mRend->windowHeight()); }
 
@@ -107,6 +128,11 @@ void Engine::callEventCallbacks() {
 
 const std::list<std::shared_ptr<Event>>& Engine::events() const { return mEventQueue; }
 
+uint64_t Engine::frameCount() const { return mFrameCount; }
+double Engine::elapsedTime() const { return ((double)(mTimeCurrent - mTimeStart).count()) / 1.0e9; }
+const Renderer& Engine::renderer() const { return *mRend.get(); }
+Renderer& Engine::renderer() { return *mRend.get(); }
+
 void Engine::quit() { mQuit = true; }
 
 
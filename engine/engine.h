@@ -10,6 +10,8 @@
 
 #include "event.h"
 #include "camera.h"
+#include "transformstore.h"
+#include "jobsystem.h"
 
 #include <atomic>
 #include <memory>
@@ -25,7 +27,12 @@ class Engine
 public:
   using GlobalEventCallback = std::function<void(Engine&, Event&)>;
 
-  Engine();
+  /**
+   * @param headless Run without a window, rendering to offscreen images
+   *                 Useful for benchmarking/running on machines without a display.
+   *                 In this case the engine will run until quit is called.
+   */
+  Engine(bool headless = false);
   ~Engine();
 
   /** 
@@ -48,6 +55,38 @@ public:
    */
   Camera& camera();
 
+  /**
+   * Flat storage for node transformations, updated each frame before the update traversal
+   * Nodes are only stored here if bound with Node::bindTransforms
+   */
+  TransformStore& transforms();
+
+  /**
+   * Job system, for work to be spread over all cores
+   * Started with the engine, the calling thread is expected to wait on/help with jobs
+   */
+  JobSystem& jobs();
+
+  enum class UpdateMode {
+    /// Depth first on the calling thread, deterministic
+    Serial,
+    /// Subtrees updated and culled in parallel, see Node::updateParallel and Node::renderParallel
+    Parallel,
+  };
+  /// How the update and render traversals are performed, parallel by default
+  void updateMode(UpdateMode mode);
+  UpdateMode updateMode() const;
+
+  enum class RenderMode {
+    /// Frames are recorded and submitted by the loop, after the update traversal
+    Inline,
+    /// Frames are recorded and submitted on a render thread, overlapping the next frame's update
+    Threaded,
+  };
+  /// How frames are submitted, threaded by default. Must be set before run
+  void renderMode(RenderMode mode);
+  RenderMode renderMode() const;
+
   /// The dimensions of the window (pixels)
   float windowWidth() const;
   float windowHeight() const;
@@ -60,6 +99,14 @@ public:
 
   const std::list<std::shared_ptr<Event>>& events() const;
 
+  /// Number of frames rendered by the loop so far
+  uint64_t frameCount() const;
+  /// Total time spent in the loop, excluding setup (seconds)
+  double elapsedTime() const;
+  /// The renderer, to query frame statistics and similar
+  const Renderer& renderer() const;
+  Renderer& renderer();
+
   /**
    * Call to quit the rendering loop, shutdown the engine/renderer
    */
@@ -70,6 +117,7 @@ private:
   void loop();
   void cleanup();
 
+  std::unique_ptr<JobSystem> mJobs;
   std::unique_ptr<Renderer> mRend;
   std::shared_ptr<Node> mNodeGraph;
 
@@ -77,6 +125,10 @@ private:
   std::chrono::time_point<std::chrono::high_resolution_clock> mTimeCurrent;
 
   Camera mCamera;
+  TransformStore mTransforms;
+  UpdateMode mUpdateMode = UpdateMode::Parallel;
+  RenderMode mRenderMode = RenderMode::Threaded;
+  uint64_t mFrameCount = 0u;
 
   std::list<std::shared_ptr<Event>> mEventQueue;
   std::list<GlobalEventCallback> mGlobalEventCallbacks;
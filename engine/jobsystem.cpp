@@ -0,0 +1,245 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+  // Which JobSystem/worker the current thread belongs to
+  thread_local const JobSystem* tJobSystem = nullptr;
+  thread_local uint32_t tWorkerIndex = 0u;
+}
+
+JobSystem::JobSystem(uint32_t numWorkers) {
+  if( numWorkers == 0 ) {
+    auto hwThreads = std::thread::hardware_concurrency();
+    numWorkers = hwThreads > 1 ? hwThreads - 1 : 1;
+  }
+
+  // Queue 0 is shared by any threads which aren't workers
+  for( auto i = 0u; i < numWorkers + 1; ++i ) mWorkers.emplace_back(new Worker());
+  mStatsStart = std::chrono::steady_clock::now();
+  for( auto i = 1u; i < numWorkers + 1; ++i ) mThreads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mQuit = true;
+  }
+  mSleepCondition.notify_all();
+  for( auto& t : mThreads ) t.join();
+}
+
+void JobSystem::run(Job job, Counter* counter) {
+  if( counter ) counter->mPending++;
+  push({std::move(job), counter});
+}
+
+void JobSystem::runAfter(Counter& dependency, Job job, Counter* counter) {
+  if( counter ) counter->mPending++;
+  {
+    std::lock_guard<std::mutex> lock(dependency.mMutex);
+    if( dependency.mPending != 0 ) {
+      dependency.mContinuations.emplace_back(std::move(job), counter);
+      return;
+    }
+  }
+  push({std::move(job), counter});
+}
+
+void JobSystem::wait(Counter& counter) {
+  auto index = threadIndex();
+  while( !counter.done() ) {
+    if( tryRunOne(index) ) continue;
+
+    // Nothing to run, sleep until more jobs are queued or the counter completes
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    mSleepCondition.wait(lock, [&]() { return counter.done() || mQueued > 0; });
+  }
+
+  // The last job may still be inside complete, the lock ensures it's finished
+  // with the counter before the caller is free to destroy it
+  std::lock_guard<std::mutex> lock(counter.mMutex);
+  if( counter.mException ) {
+    auto e = counter.mException;
+    counter.mException = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grainSize, RangeJob job) {
+  if( count == 0 ) return;
+  if( grainSize == 0 ) {
+    // A few jobs per thread, so stealing can balance uneven work
+    auto numThreads = workerCount() + 1;
+    grainSize = std::max(1u, count / (numThreads * 4u));
+  }
+  if( grainSize >= count ) {
+    job(0, count);
+    return;
+  }
+
+  Counter counter;
+  for( auto begin = 0u; begin < count; begin += grainSize ) {
+    auto end = std::min(count, begin + grainSize);
+    run([&job, begin, end]() { job(begin, end); }, &counter);
+  }
+  wait(counter);
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+  tJobSystem = this;
+  tWorkerIndex = index;
+
+  while( !mQuit ) {
+    if( tryRunOne(index) ) continue;
+
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    mSleepCondition.wait(lock, [&]() { return mQuit || mQueued > 0; });
+  }
+}
+
+void JobSystem::push(QueuedJob job) {
+  // Counted before it's visible, so the count never drops below zero
+  mQueued++;
+  auto& worker = *mWorkers[threadIndex()];
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.queue.emplace_back(std::move(job));
+  }
+  {
+    // Ensures a worker about to sleep sees mQueued
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+  }
+  mSleepCondition.notify_one();
+}
+
+bool JobSystem::tryRunOne(uint32_t index) {
+  QueuedJob job;
+  bool found = false;
+  bool stolen = false;
+
+  // Newest job from our own queue, it's likely to be hot in cache
+  {
+    auto& own = *mWorkers[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if( !own.queue.empty() ) {
+      job = std::move(own.queue.back());
+      own.queue.pop_back();
+      found = true;
+    }
+  }
+
+  // Otherwise steal the oldest job from another queue
+  for( auto i = 1u; !found && i < mWorkers.size(); ++i ) {
+    auto& victim = *mWorkers[(index + i) % mWorkers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if( !victim.queue.empty() ) {
+      job = std::move(victim.queue.front());
+      victim.queue.pop_front();
+      found = true;
+      stolen = true;
+    }
+  }
+
+  if( !found ) return false;
+  mQueued--;
+  if( stolen ) mWorkers[index]->jobsStolen++;
+  execute(index, job);
+  return true;
+}
+
+void JobSystem::execute(uint32_t index, QueuedJob& job) {
+  auto start = std::chrono::steady_clock::now();
+  try {
+    job.job();
+  }
+  catch (...) {
+    if( job.counter ) {
+      std::lock_guard<std::mutex> lock(job.counter->mMutex);
+      if( !job.counter->mException ) job.counter->mException = std::current_exception();
+    } else {
+      std::cerr << "JobSystem: Unhandled exception in job" << std::endl;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  auto& worker = *mWorkers[index];
+  worker.jobsExecuted++;
+  worker.busyNanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+  complete(job.counter);
+}
+
+void JobSystem::complete(Counter* counter) {
+  if( !counter ) return;
+
+  // Decremented under the lock, see wait
+  std::vector<std::pair<Job, Counter*>> continuations;
+  bool completed = false;
+  {
+    std::lock_guard<std::mutex> lock(counter->mMutex);
+    if( --counter->mPending == 0 ) {
+      std::swap(continuations, counter->mContinuations);
+      completed = true;
+    }
+  }
+
+  if( completed ) {
+    // Wake anything blocked in wait. The counter mustn't be touched from here,
+    // a waiter may destroy it as soon as it sees the counter complete
+    {
+      std::lock_guard<std::mutex> lock(mSleepMutex);
+    }
+    mSleepCondition.notify_all();
+  }
+
+  // Counters of the continuations were incremented by runAfter
+  for( auto& c : continuations ) push({std::move(c.first), c.second});
+}
+
+uint32_t JobSystem::threadIndex() const {
+  return tJobSystem == this ? tWorkerIndex : 0u;
+}
+
+std::vector<JobSystem::WorkerStats> JobSystem::stats() const {
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStatsStart).count();
+  std::vector<WorkerStats> result;
+  for( auto& w : mWorkers ) {
+    WorkerStats s;
+    s.jobsExecuted = w->jobsExecuted;
+    s.jobsStolen = w->jobsStolen;
+    s.busyTime = static_cast<double>(w->busyNanoseconds) / 1.0e9;
+    s.utilisation = elapsed > 0.0 ? s.busyTime / elapsed : 0.0;
+    result.emplace_back(s);
+  }
+  return result;
+}
+
+void JobSystem::resetStats() {
+  for( auto& w : mWorkers ) {
+    w->jobsExecuted = 0u;
+    w->jobsStolen = 0u;
+    w->busyNanoseconds = 0u;
+  }
+  mStatsStart = std::chrono::steady_clock::now();
+}
+
+void JobSystem::printStats(std::ostream& stream) const {
+  auto s = stats();
+  stream << "JobSystem: " << workerCount() << " workers" << std::endl;
+  for( auto i = 0u; i < s.size(); ++i ) {
+    stream << "  " << (i == 0 ? std::string("external") : "worker " + std::to_string(i))
+           << ": jobs " << s[i].jobsExecuted
+           << ", stolen " << s[i].jobsStolen
+           << ", busy " << s[i].busyTime << "s"
+           << " (" << s[i].utilisation * 100.0 << "%)" << std::endl;
+  }
+}
@@ -0,0 +1,150 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing job scheduler
+ * - Each worker has its own queue, new jobs are pushed to the queue of the
+ *   thread that created them
+ * - Workers take the most recent job from their own queue, and steal
+ *   the oldest job from others when empty
+ * - Completion is tracked through Counters, which jobs may depend on
+ * - Threads waiting on a counter execute jobs until it completes, so
+ *   jobs may wait on other jobs without deadlocking
+ *
+ * Threads which aren't workers (The main and render threads) share an extra queue.
+ */
+class JobSystem
+{
+public:
+  using Job = std::function<void()>;
+  using RangeJob = std::function<void(uint32_t begin, uint32_t end)>;
+
+  /**
+   * Completion counter for a group of jobs
+   * Incremented when a job is queued, decremented once it has run
+   */
+  class Counter
+  {
+  public:
+    Counter() = default;
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    bool done() const { return mPending == 0; }
+
+  private:
+    friend class JobSystem;
+    std::atomic<uint32_t> mPending{0};
+    // Jobs to queue once the counter completes
+    std::mutex mMutex;
+    std::vector<std::pair<Job, Counter*>> mContinuations;
+    // First exception thrown by a job, rethrown by wait
+    std::exception_ptr mException;
+  };
+
+  /// Statistics for each worker. Index 0 is threads which aren't workers
+  struct WorkerStats {
+    uint64_t jobsExecuted = 0u;
+    uint64_t jobsStolen = 0u;
+    /// Time spent executing jobs (seconds)
+    double busyTime = 0.0;
+    /// busyTime as a fraction of the time since stats were last reset
+    double utilisation = 0.0;
+  };
+
+  /**
+   * @param numWorkers Number of worker threads, if 0 one
+   *                   less than the number of hardware threads
+   */
+  JobSystem(uint32_t numWorkers = 0);
+  ~JobSystem();
+
+  /// Queue a job, counter (if specified) will be incremented until the job has run
+  void run(Job job, Counter* counter = nullptr);
+  /// Queue a job once dependency has completed
+  void runAfter(Counter& dependency, Job job, Counter* counter = nullptr);
+
+  /// Block until a counter completes, executing jobs while waiting
+  /// Sleeps if there's nothing to execute
+  /// Rethrows the first exception thrown by any of the counter's jobs
+  void wait(Counter& counter);
+
+  /**
+   * Run job over [0, count) in parallel, returning once complete
+   * @param grainSize Number of items per job, if 0 chosen based on the number of workers
+   */
+  void parallelFor(uint32_t count, uint32_t grainSize, RangeJob job);
+
+  /// Number of worker threads, not including the caller
+  uint32_t workerCount() const { return static_cast<uint32_t>(mThreads.size()); }
+  /**
+   * Index of the calling thread, in [0, workerCount()]
+   * 0 for any thread which isn't a worker. Useful for per-thread resources,
+   * a thread only executes one job at a time (Unless the job waits)
+   */
+  uint32_t threadIndex() const;
+
+  std::vector<WorkerStats> stats() const;
+  void resetStats();
+  void printStats(std::ostream& stream) const;
+
+private:
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  struct QueuedJob {
+    Job job;
+    Counter* counter = nullptr;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<QueuedJob> queue;
+
+    std::atomic<uint64_t> jobsExecuted{0};
+    std::atomic<uint64_t> jobsStolen{0};
+    std::atomic<uint64_t> busyNanoseconds{0};
+  };
+
+  void workerLoop(uint32_t index);
+  void push(QueuedJob job);
+  /// Take a job from our own queue, or steal one. @return false if none available
+  bool tryRunOne(uint32_t index);
+  void execute(uint32_t index, QueuedJob& job);
+  void complete(Counter* counter);
+
+  // Index 0 is for threads which aren't workers
+  std::vector<std::unique_ptr<Worker>> mWorkers;
+  std::vector<std::thread> mThreads;
+
+  // Number of queued jobs, used to put workers and waiting threads to sleep
+  // Notified when jobs are queued and when a counter completes
+  std::atomic<uint32_t> mQueued{0};
+  std::mutex mSleepMutex;
+  std::condition_variable mSleepCondition;
+  std::atomic<bool> mQuit{false};
+
+  std::chrono::steady_clock::time_point mStatsStart;
+};
+
+#endif
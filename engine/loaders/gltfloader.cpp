@@ -64,11 +64,11 @@ void GLTFLoader::parseGltfNode(std::shared_ptr<Node> targetParent, tinygltf::Nod
   std::shared_ptr<Node> n(new Node());
 
   // Node's model matrix
-  if (gNode.translation.size() == 3) n->translation() = glm::make_vec3(gNode.translation.data());
+  if (gNode.translation.size() == 3) n->translation(glm::make_vec3(gNode.translation.data()));
   if (gNode.rotation.size() == 4) {
     std::cerr << "TODO: GLTF Loader - Need node rotation from quat, ignoring rotation from gltf model" << std::endl;
   }
-  if (gNode.scale.size() == 3) n->scale() = glm::make_vec3(gNode.scale.data());
+  if (gNode.scale.size() == 3) n->scale(glm::make_vec3(gNode.scale.data()));
   if (gNode.matrix.size() == 16) {
     std::cerr << "TODO: GLTF Loader - Setting matrix explicitly may conflict/add to separate translation/scale parameters?" << std::endl;
     n->userModelMatrix(glm::make_mat4x4(gNode.matrix.data()));
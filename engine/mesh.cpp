@@ -12,7 +12,13 @@
 Mesh::Mesh(const std::vector<Vertex>& v, const std::vector<uint32_t>& i)
   : mVertices(v)
     , mIndices(i)
-{}
+{
+  for( auto& vert : mVertices ) mLocalAABB.expand(vert.position);
+  if( mLocalAABB.valid() ) {
+    mLocalSphere.centre = mLocalAABB.centre();
+    for( auto& vert : mVertices ) mLocalSphere.radius = std::max(mLocalSphere.radius, glm::length(vert.position - mLocalSphere.centre));
+  }
+}
 
 void Mesh::upload(Renderer& rend) {
   if( mVertices.empty() || mIndices.empty() ) {
@@ -20,24 +26,13 @@ void Mesh::upload(Renderer& rend) {
     // the mesh if it's asked to use it
     return;
   }
-  mVertexBuffer = rend.createSimpleVertexBuffer(mVertices);
-  std::memcpy(mVertexBuffer->map(), mVertices.data(), mVertices.size() * sizeof(decltype(mVertices)::value_type));
-  mVertexBuffer->flush();
-  mVertexBuffer->unmap();
+  mGeometry = rend.uploadGeometry(mVertices, mIndices);
   mVertices.clear();
-
-  if( !mIndices.empty() ) {
-    mIndexBuffer = rend.createSimpleIndexBuffer(mIndices);
-    std::memcpy(mIndexBuffer->map(), mIndices.data(), mIndices.size() * sizeof(decltype(mIndices)::value_type));
-    mIndexBuffer->flush();
-    mIndexBuffer->unmap();
-    mIndices.clear();
-  }
+  mIndices.clear();
 }
 
 void Mesh::cleanup(Renderer& rend) {
-  mVertexBuffer.reset();
-  mIndexBuffer.reset();
+  rend.freeGeometry(mGeometry);
 }
 
-bool Mesh::validForRender() const { return mVertexBuffer && mIndexBuffer; }
+bool Mesh::validForRender() const { return mGeometry.valid(); }
@@ -9,8 +9,9 @@
 #define MESH_H
 
 #include "vertex.h"
+#include "bounds.h"
 
-#include "util/simplebuffer.h"
+#include "geometrypool.h"
 
 #include <vector>
 #include <memory>
@@ -34,11 +35,13 @@ struct Mesh {
     std::vector<Vertex> mVertices;
     std::vector<uint32_t> mIndices;
 
+    // Bounds of the vertices in model space, calculated on construction
+    AABB mLocalAABB;
+    Sphere mLocalSphere;
+
     // TODO: Directly referencing vulkan-specific stuff here, would need to change with alternate Renderer implementation
-    std::unique_ptr<SimpleBuffer> mVertexBuffer;
-    std::unique_ptr<SimpleBuffer> mIndexBuffer;
-    // TODO: Store command buffer on a per-mesh basis, or recreate each frame? What's faster?
-    // TODO: Currently making a separate buffer for each mesh, should have a batched version/auto-batch things
+    // Location of the mesh within the Renderer's geometry pool
+    GeometryPool::Handle mGeometry;
 };
 
 #endif
@@ -0,0 +1,212 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "transformstore.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+# include <xmmintrin.h>
+# define TRANSFORMSTORE_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define TRANSFORMSTORE_NEON
+#endif
+
+namespace {
+  /// out = a * b, column major. out must not alias a or b
+  inline void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+    const float* pa = &a[0][0];
+    const float* pb = &b[0][0];
+    float* po = &out[0][0];
+#if defined(TRANSFORMSTORE_SSE)
+    // Each column of the result is a sum of a's columns, weighted by b's column
+    auto a0 = _mm_loadu_ps(pa);
+    auto a1 = _mm_loadu_ps(pa + 4);
+    auto a2 = _mm_loadu_ps(pa + 8);
+    auto a3 = _mm_loadu_ps(pa + 12);
+    for( auto c = 0; c < 4; ++c ) {
+      auto bc = pb + c * 4;
+      auto r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+      r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+      r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+      r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+      _mm_storeu_ps(po + c * 4, r);
+    }
+#elif defined(TRANSFORMSTORE_NEON)
+    auto a0 = vld1q_f32(pa);
+    auto a1 = vld1q_f32(pa + 4);
+    auto a2 = vld1q_f32(pa + 8);
+    auto a3 = vld1q_f32(pa + 12);
+    for( auto c = 0; c < 4; ++c ) {
+      auto bc = pb + c * 4;
+      auto r = vmulq_n_f32(a0, bc[0]);
+      r = vmlaq_n_f32(r, a1, bc[1]);
+      r = vmlaq_n_f32(r, a2, bc[2]);
+      r = vmlaq_n_f32(r, a3, bc[3]);
+      vst1q_f32(po + c * 4, r);
+    }
+#else
+    for( auto c = 0; c < 4; ++c ) {
+      for( auto r = 0; r < 4; ++r ) {
+        po[c * 4 + r] = pa[r] * pb[c * 4] + pa[4 + r] * pb[c * 4 + 1] + pa[8 + r] * pb[c * 4 + 2] + pa[12 + r] * pb[c * 4 + 3];
+      }
+    }
+#endif
+  }
+}
+
+TransformStore::TransformStore() {}
+TransformStore::~TransformStore() {}
+
+TransformStore::Index TransformStore::add(Index parent, const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale) {
+  auto index = size();
+  if( parent != invalidIndex && parent >= index ) throw std::runtime_error("TransformStore::add: Parent must be added before its children");
+
+  mParents.emplace_back(parent);
+  mTranslations.emplace_back(translation);
+  mRotations.emplace_back(rotation);
+  mScales.emplace_back(scale);
+  mTranslationDeltas.emplace_back(0.f);
+  mRotationDeltas.emplace_back(0.f);
+  mScaleDeltas.emplace_back(0.f);
+  mAnimated.emplace_back(0u);
+  mUserMatrices.emplace_back(1.f);
+  mHasUserMatrix.emplace_back(0u);
+  mLocalMatrices.emplace_back(1.f);
+  mWorldMatrices.emplace_back(1.f);
+  mWorldVersions.emplace_back(0u);
+  mLocalDirty.emplace_back(1u);
+  mWorldChanged.emplace_back(0u);
+  return index;
+}
+
+void TransformStore::reserve(uint32_t count) {
+  mParents.reserve(count);
+  mTranslations.reserve(count);
+  mRotations.reserve(count);
+  mScales.reserve(count);
+  mTranslationDeltas.reserve(count);
+  mRotationDeltas.reserve(count);
+  mScaleDeltas.reserve(count);
+  mAnimated.reserve(count);
+  mUserMatrices.reserve(count);
+  mHasUserMatrix.reserve(count);
+  mLocalMatrices.reserve(count);
+  mWorldMatrices.reserve(count);
+  mWorldVersions.reserve(count);
+  mLocalDirty.reserve(count);
+  mWorldChanged.reserve(count);
+}
+
+void TransformStore::clear() {
+  mParents.clear();
+  mTranslations.clear();
+  mRotations.clear();
+  mScales.clear();
+  mTranslationDeltas.clear();
+  mRotationDeltas.clear();
+  mScaleDeltas.clear();
+  mAnimated.clear();
+  mUserMatrices.clear();
+  mHasUserMatrix.clear();
+  mLocalMatrices.clear();
+  mWorldMatrices.clear();
+  mWorldVersions.clear();
+  mLocalDirty.clear();
+  mWorldChanged.clear();
+}
+
+void TransformStore::translation(Index i, const glm::vec3& t) { mTranslations[i] = t; mLocalDirty[i] = 1u; }
+void TransformStore::rotation(Index i, const glm::vec3& r) { mRotations[i] = r; mLocalDirty[i] = 1u; }
+void TransformStore::scale(Index i, const glm::vec3& s) { mScales[i] = s; mLocalDirty[i] = 1u; }
+
+void TransformStore::translationDelta(Index i, const glm::vec3& t) {
+  mTranslationDeltas[i] = t;
+  mAnimated[i] = mTranslationDeltas[i] != glm::vec3(0.f) || mRotationDeltas[i] != glm::vec3(0.f) || mScaleDeltas[i] != glm::vec3(0.f);
+}
+void TransformStore::rotationDelta(Index i, const glm::vec3& r) {
+  mRotationDeltas[i] = r;
+  mAnimated[i] = mTranslationDeltas[i] != glm::vec3(0.f) || mRotationDeltas[i] != glm::vec3(0.f) || mScaleDeltas[i] != glm::vec3(0.f);
+}
+void TransformStore::scaleDelta(Index i, const glm::vec3& s) {
+  mScaleDeltas[i] = s;
+  mAnimated[i] = mTranslationDeltas[i] != glm::vec3(0.f) || mRotationDeltas[i] != glm::vec3(0.f) || mScaleDeltas[i] != glm::vec3(0.f);
+}
+
+void TransformStore::userMatrix(Index i, const glm::mat4& m) {
+  mUserMatrices[i] = m;
+  mHasUserMatrix[i] = m != glm::mat4(1.f);
+  mLocalDirty[i] = 1u;
+}
+
+void TransformStore::update(double deltaT) {
+  updateDeltas(static_cast<float>(deltaT));
+  updateLocalMatrices();
+  updateWorldMatrices();
+}
+
+void TransformStore::updateDeltas(float deltaT) {
+  auto n = size();
+  for( auto i = 0u; i < n; ++i ) {
+    if( !mAnimated[i] ) continue;
+    mTranslations[i] += mTranslationDeltas[i] * deltaT;
+    mRotations[i] += mRotationDeltas[i] * deltaT;
+    mScales[i] += mScaleDeltas[i] * deltaT;
+    mLocalDirty[i] = 1u;
+  }
+}
+
+void TransformStore::updateLocalMatrices() {
+  auto n = size();
+  for( auto i = 0u; i < n; ++i ) {
+    if( !mLocalDirty[i] ) continue;
+
+    // rotX * rotY * rotZ, built directly rather than through glm::rotate
+    auto& r = mRotations[i];
+    auto cx = std::cos(r.x), sx = std::sin(r.x);
+    auto cy = std::cos(r.y), sy = std::sin(r.y);
+    auto cz = std::cos(r.z), sz = std::sin(r.z);
+    glm::mat3 rx(1.f, 0.f, 0.f,  0.f, cx, sx,  0.f, -sx, cx);
+    glm::mat3 ry(cy, 0.f, -sy,  0.f, 1.f, 0.f,  sy, 0.f, cy);
+    glm::mat3 rz(cz, sz, 0.f,  -sz, cz, 0.f,  0.f, 0.f, 1.f);
+    auto rot = rx * ry * rz;
+
+    // translate * rotate * scale
+    auto& s = mScales[i];
+    auto& t = mTranslations[i];
+    glm::mat4 m(
+      glm::vec4(rot[0] * s.x, 0.f),
+      glm::vec4(rot[1] * s.y, 0.f),
+      glm::vec4(rot[2] * s.z, 0.f),
+      glm::vec4(t, 1.f));
+
+    if( mHasUserMatrix[i] ) multiply(mUserMatrices[i], m, mLocalMatrices[i]);
+    else mLocalMatrices[i] = m;
+  }
+}
+
+void TransformStore::updateWorldMatrices() {
+  // Parents are always before their children, so a parent's
+  // world matrix is final by the time its children are visited
+  auto n = size();
+  for( auto i = 0u; i < n; ++i ) {
+    auto p = mParents[i];
+    auto parentChanged = p != invalidIndex && mWorldChanged[p];
+    if( !mLocalDirty[i] && !parentChanged ) {
+      mWorldChanged[i] = 0u;
+      continue;
+    }
+
+    if( p == invalidIndex ) mWorldMatrices[i] = mLocalMatrices[i];
+    else multiply(mWorldMatrices[p], mLocalMatrices[i], mWorldMatrices[i]);
+    mWorldVersions[i]++;
+    mWorldChanged[i] = 1u;
+    mLocalDirty[i] = 0u;
+  }
+}
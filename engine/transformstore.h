@@ -0,0 +1,114 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef TRANSFORMSTORE_H
+#define TRANSFORMSTORE_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Flat storage for a hierarchy of transforms
+ * - Each attribute is held in its own contiguous array (Structure of arrays)
+ * - Transforms are stored parent-before-child, so world matrices
+ *   are calculated in a single linear pass
+ * - Matrix multiplies use SSE/NEON where available
+ *
+ * Transforms are only added, never removed. To rebuild the
+ * hierarchy clear the store and add them again.
+ *
+ * Local matrices are calculated as user * translate * rotX * rotY * rotZ * scale,
+ * matching Node::matrix.
+ */
+class TransformStore
+{
+public:
+  using Index = uint32_t;
+  static const Index invalidIndex = ~0u;
+
+  TransformStore();
+  ~TransformStore();
+
+  /**
+   * Add a transform
+   * @param parent Index of the parent, must already be in the store. invalidIndex for a root
+   * @return Index of the new transform
+   */
+  Index add(Index parent,
+            const glm::vec3& translation = glm::vec3(0.f),
+            const glm::vec3& rotation = glm::vec3(0.f),
+            const glm::vec3& scale = glm::vec3(1.f));
+  void reserve(uint32_t count);
+  void clear();
+  uint32_t size() const { return static_cast<uint32_t>(mParents.size()); }
+
+  Index parent(Index i) const { return mParents[i]; }
+
+  const glm::vec3& translation(Index i) const { return mTranslations[i]; }
+  const glm::vec3& rotation(Index i) const { return mRotations[i]; }
+  const glm::vec3& scale(Index i) const { return mScales[i]; }
+  void translation(Index i, const glm::vec3& t);
+  void rotation(Index i, const glm::vec3& r);
+  void scale(Index i, const glm::vec3& s);
+
+  /// Change per second, applied by update
+  const glm::vec3& translationDelta(Index i) const { return mTranslationDeltas[i]; }
+  const glm::vec3& rotationDelta(Index i) const { return mRotationDeltas[i]; }
+  const glm::vec3& scaleDelta(Index i) const { return mScaleDeltas[i]; }
+  void translationDelta(Index i, const glm::vec3& t);
+  void rotationDelta(Index i, const glm::vec3& r);
+  void scaleDelta(Index i, const glm::vec3& s);
+
+  /// Applied before the other transformations, see Node::userModelMatrix
+  void userMatrix(Index i, const glm::mat4& m);
+  const glm::mat4& userMatrix(Index i) const { return mUserMatrices[i]; }
+
+  /// Matrices, as of the last update
+  const glm::mat4& localMatrix(Index i) const { return mLocalMatrices[i]; }
+  const glm::mat4& worldMatrix(Index i) const { return mWorldMatrices[i]; }
+  /// Incremented each time the world matrix changes
+  uint64_t worldVersion(Index i) const { return mWorldVersions[i]; }
+
+  /**
+   * Apply deltas, and recalculate any changed matrices
+   * Transforms which haven't changed (and whose parents haven't changed) are skipped
+   */
+  void update(double deltaT);
+
+private:
+  void updateDeltas(float deltaT);
+  void updateLocalMatrices();
+  void updateWorldMatrices();
+
+  std::vector<Index> mParents;
+
+  std::vector<glm::vec3> mTranslations;
+  std::vector<glm::vec3> mRotations;
+  std::vector<glm::vec3> mScales;
+
+  std::vector<glm::vec3> mTranslationDeltas;
+  std::vector<glm::vec3> mRotationDeltas;
+  std::vector<glm::vec3> mScaleDeltas;
+  // Whether any of the deltas are non-zero
+  std::vector<uint8_t> mAnimated;
+
+  std::vector<glm::mat4> mUserMatrices;
+  std::vector<uint8_t> mHasUserMatrix;
+
+  std::vector<glm::mat4> mLocalMatrices;
+  std::vector<glm::mat4> mWorldMatrices;
+  std::vector<uint64_t> mWorldVersions;
+
+  // Local transform needs recalculating
+  std::vector<uint8_t> mLocalDirty;
+  // World matrix changed in the last update, used to propagate to children
+  std::vector<uint8_t> mWorldChanged;
+};
+
+#endif
@@ -25,3 +25,5 @@ void LightNode::doRender(Renderer& rend, mat4x4 nodeMat, mat4x4, mat4x4)
 
 Light& LightNode::light() { return mLight; }
 
+
+bool LightNode::doCullable() const { return false; }
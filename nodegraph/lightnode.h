@@ -23,6 +23,8 @@ public:
 
   // Render this node and any children
   void doRender(Renderer& rend, mat4x4 nodeMat, mat4x4 viewMat, mat4x4 projMat) override;
+  // Lights affect the whole scene, never culled
+  bool doCullable() const override;
 
   Light& light();
 private:
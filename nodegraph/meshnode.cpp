@@ -39,5 +39,12 @@ void MeshNode::doCleanup(Renderer& rend) {
   if (mMesh) mMesh->cleanup(rend);
 }
 
+AABB MeshNode::doBounds() const {
+  if (mMesh) return mMesh->mLocalAABB;
+  return AABB();
+}
+
+bool MeshNode::doCullable() const { return true; }
+
 void MeshNode::mesh(std::shared_ptr<Mesh> mesh) { mMesh = mesh; }
 void MeshNode::material(std::shared_ptr<Material> mat) { mMaterial = mat; }
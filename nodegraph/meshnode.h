@@ -27,6 +27,8 @@ public:
   void doUpload(Renderer& rend) override;
   void doRender(Renderer& rend, mat4x4 nodeMat, mat4x4 viewMat, mat4x4 projMat) override;
   void doCleanup(Renderer& rend) override;
+  AABB doBounds() const override;
+  bool doCullable() const override;
 
   void mesh(std::shared_ptr<Mesh> mesh);
   void material(std::shared_ptr<Material> mat);
@@ -1,6 +1,10 @@
 #include "node.h"
 #include "renderer.h"
 
+#include <algorithm>
+#include <mutex>
+#include <typeinfo>
+
     Node::Node()
     {
     }
@@ -10,16 +14,67 @@
     }
 
     Node::Children& Node::children() { return mChildren; }
-    vec3& Node::scale() { return mScale; }
-    vec3& Node::rotation() { return mRot; }
-    vec3& Node::translation() { return mTrans; }
+    // If bound to a TransformStore the store holds the transformation
+    const vec3& Node::scale() const { return mTransforms ? mTransforms->scale(mTransformIndex) : mScale; }
+    const vec3& Node::rotation() const { return mTransforms ? mTransforms->rotation(mTransformIndex) : mRot; }
+    const vec3& Node::translation() const { return mTransforms ? mTransforms->translation(mTransformIndex) : mTrans; }
+    void Node::scale(const vec3& s) {
+        if( mTransforms ) mTransforms->scale(mTransformIndex, s);
+        else { mScale = s; transformChanged(); }
+    }
+    void Node::rotation(const vec3& r) {
+        if( mTransforms ) mTransforms->rotation(mTransformIndex, r);
+        else { mRot = r; transformChanged(); }
+    }
+    void Node::translation(const vec3& t) {
+        if( mTransforms ) mTransforms->translation(mTransformIndex, t);
+        else { mTrans = t; transformChanged(); }
+    }
+
+    const vec3& Node::scaleDelta() const { return mTransforms ? mTransforms->scaleDelta(mTransformIndex) : mScaleDelta; }
+    const vec3& Node::rotationDelta() const { return mTransforms ? mTransforms->rotationDelta(mTransformIndex) : mRotDelta; }
+    const vec3& Node::translationDelta() const { return mTransforms ? mTransforms->translationDelta(mTransformIndex) : mTransDelta; }
+    void Node::scaleDelta(const vec3& s) {
+        if( mTransforms ) mTransforms->scaleDelta(mTransformIndex, s);
+        else mScaleDelta = s;
+    }
+    void Node::rotationDelta(const vec3& r) {
+        if( mTransforms ) mTransforms->rotationDelta(mTransformIndex, r);
+        else mRotDelta = r;
+    }
+    void Node::translationDelta(const vec3& t) {
+        if( mTransforms ) mTransforms->translationDelta(mTransformIndex, t);
+        else mTransDelta = t;
+    }
+
+    void Node::bindTransforms(TransformStore& store, TransformStore::Index parent)
+    {
+        if( mTransforms ) return;
 
-    vec3& Node::scaleDelta() { return mScaleDelta; }
-    vec3& Node::rotationDelta() { return mRotDelta; }
-    vec3& Node::translationDelta() { return mTransDelta; }
+        // Depth first, so parents are always added before their children
+        mTransformIndex = store.add(parent, mTrans, mRot, mScale);
+        store.translationDelta(mTransformIndex, mTransDelta);
+        store.rotationDelta(mTransformIndex, mRotDelta);
+        store.scaleDelta(mTransformIndex, mScaleDelta);
+        store.userMatrix(mTransformIndex, mUserModelMat);
+        mTransforms = &store;
 
-    mat4x4 Node::matrix() const
+        for( auto& c : mChildren ) c->bindTransforms(store, mTransformIndex);
+    }
+
+    TransformStore::Index Node::transformIndex() const { return mTransforms ? mTransformIndex : TransformStore::invalidIndex; }
+
+    void Node::transformChanged()
+    {
+        mLocalMatDirty = true;
+        mLocalVersion++;
+    }
+
+    const mat4x4& Node::matrix() const
     {
+        if( mTransforms ) return mTransforms->localMatrix(mTransformIndex);
+        if( !mLocalMatDirty ) return mLocalMat;
+
         mat4x4 m(1.0);
 
         m *= mUserModelMat;
@@ -31,11 +86,19 @@
         m = rotate(m, mRot[2], vec3(0.f,0.f,1.f));
 
         m = glm::scale(m, mScale);
-        
-        return m;
+
+        mLocalMat = m;
+        mLocalMatDirty = false;
+        return mLocalMat;
     }
 
-    void Node::userModelMatrix(mat4x4 mat) { mUserModelMat = mat; }
+    const mat4x4& Node::worldMatrix() const { return mWorldMat; }
+
+    void Node::userModelMatrix(mat4x4 mat) {
+        if( mTransforms ) mTransforms->userMatrix(mTransformIndex, mat);
+        else { mUserModelMat = mat; transformChanged(); }
+    }
+    const mat4x4& Node::userModelMatrix() const { return mTransforms ? mTransforms->userMatrix(mTransformIndex) : mUserModelMat; }
 
     vec3 Node::modelVecToWorldVec( vec3 v )
     {
@@ -43,10 +106,11 @@
         // so don't care about scale/translate
         mat4x4 m(1.0);
 
-        m *= mUserModelMat;
-        m = rotate(m, mRot[0], - vec3(1.f,0.f,0.f));
-        m = rotate(m, mRot[1], - vec3(0.f,1.f,0.f));
-        m = rotate(m, mRot[2], - vec3(0.f,0.f,1.f));
+        auto& rot = rotation();
+        m *= userModelMatrix();
+        m = rotate(m, rot[0], - vec3(1.f,0.f,0.f));
+        m = rotate(m, rot[1], - vec3(0.f,1.f,0.f));
+        m = rotate(m, rot[2], - vec3(0.f,0.f,1.f));
         
         return vec4(v, 1.0f) * m;
     }
@@ -73,26 +137,250 @@
 
     void Node::render(Renderer& rend, mat4x4 nodeMat, mat4x4 viewMat, mat4x4 projMat)
     {
-      if( !mEnabled ) return;
+      // The root's parent is the matrix passed in, only a change
+      // to it requires the world matrices to be recalculated
+      if( nodeMat != mRootMat ) {
+        mRootMat = nodeMat;
+        mRootMatVersion++;
+      }
+      Frustum frustum(projMat * viewMat);
+      render(rend, mRootMat, &mRootMat, mRootMatVersion, viewMat, projMat, frustum, true);
+    }
+
+    void Node::render(Renderer& rend, const mat4x4& parentMat, const void* parent, uint64_t parentVersion, mat4x4 viewMat, mat4x4 projMat, const Frustum& frustum, bool testBounds)
+    {
+      if( !renderSelf(rend, parentMat, parent, parentVersion, viewMat, projMat, frustum, testBounds) ) return;
+      for( auto& c: mChildren ) c->render(rend, mWorldMat, this, mWorldVersion, viewMat, projMat, frustum, testBounds);
+    }
+
+    bool Node::renderSelf(Renderer& rend, const mat4x4& parentMat, const void* parent, uint64_t parentVersion, mat4x4 viewMat, mat4x4 projMat, const Frustum& frustum, bool& testBounds)
+    {
+      if( !mEnabled ) return false;
 
       // Apply this node's transformation matrix
-      nodeMat = nodeMat * matrix();
+      updateWorldMatrix(parentMat, parent, parentVersion);
+
+      // Skip the subtree if it's entirely outside the frustum
+      // If entirely inside there's no need to test any children
+      if( testBounds && mCullable && mBounds.valid() ) {
+        auto result = frustum.test(mBounds.transformed(mWorldMat));
+        if( result == Frustum::Result::Outside ) return false;
+        if( result == Frustum::Result::Inside ) testBounds = false;
+      }
+
+      doRender(rend, mWorldMat, viewMat, projMat);
+      return true;
+    }
+
+    // Shared by all jobs of a parallel render
+    struct Node::RenderContext {
+      Renderer& rend;
+      mat4x4 viewMat;
+      mat4x4 projMat;
+      Frustum frustum;
+      JobSystem& jobs;
+      JobSystem::Counter done;
+    };
+
+    // A node to render, and what its parent would pass down in render
+    struct Node::RenderItem {
+      Node* node;
+      const mat4x4* parentMat;
+      const void* parent;
+      uint64_t parentVersion;
+      bool testBounds;
+    };
+
+    void Node::renderParallel(Renderer& rend, mat4x4 viewMat, mat4x4 projMat, JobSystem& jobs)
+    {
+      if( !mEnabled ) return;
+
+      // As render, the root's parent is an identity matrix
+      mat4x4 nodeMat(1.0f);
+      if( nodeMat != mRootMat ) {
+        mRootMat = nodeMat;
+        mRootMatVersion++;
+      }
 
-      doRender(rend, nodeMat, viewMat, projMat);
-      for( auto& c: mChildren ) c->render(rend, nodeMat, viewMat, projMat);
+      RenderContext context{rend, viewMat, projMat, Frustum(projMat * viewMat), jobs};
+      runRenderTask({{this, &mRootMat, &mRootMat, mRootMatVersion, true}}, context);
+      // Rethrows the first exception thrown by any of the jobs
+      jobs.wait(context.done);
+    }
+
+    void Node::runRenderTask(std::vector<RenderItem> items, RenderContext& context)
+    {
+      // Siblings per job, enough to outweigh the cost of scheduling
+      const size_t chunkSize = 16u;
+
+      // Full chunks of children are handed to other jobs, the rest are rendered here
+      // Each job is counted before the one queueing it completes, so done can't complete early
+      while( !items.empty() ) {
+        std::vector<RenderItem> children;
+        for( auto& item : items ) {
+          auto n = item.node;
+          auto testBounds = item.testBounds;
+          if( !n->renderSelf(context.rend, *item.parentMat, item.parent, item.parentVersion,
+                             context.viewMat, context.projMat, context.frustum, testBounds) ) continue;
+
+          for( auto& c : n->mChildren ) {
+            children.push_back({c.get(), &n->mWorldMat, n, n->mWorldVersion, testBounds});
+            if( children.size() < chunkSize ) continue;
+            context.jobs.run([chunk = std::move(children), &context]() mutable {
+              runRenderTask(std::move(chunk), context);
+            }, &context.done);
+            children.clear();
+          }
+        }
+        items = std::move(children);
+      }
+    }
+
+    void Node::updateWorldMatrix(const mat4x4& parentMat, const void* parent, uint64_t parentVersion)
+    {
+      if( mTransforms ) {
+        // Already calculated by the store, the store's hierarchy replaces parentMat
+        auto version = mTransforms->worldVersion(mTransformIndex);
+        if( mWorldParent == mTransforms && mWorldParentVersion == version ) return;
+        mWorldMat = mTransforms->worldMatrix(mTransformIndex);
+        mWorldParent = mTransforms;
+        mWorldParentVersion = version;
+        mWorldVersion++;
+        return;
+      }
+
+      if( mWorldLocalVersion == mLocalVersion &&
+          mWorldParent == parent &&
+          mWorldParentVersion == parentVersion ) return;
+
+      mWorldMat = parentMat * matrix();
+      mWorldLocalVersion = mLocalVersion;
+      mWorldParent = parent;
+      mWorldParentVersion = parentVersion;
+      mWorldVersion++;
+    }
+
+    const AABB& Node::bounds() const { return mBounds; }
+
+    void Node::updateBounds()
+    {
+      // Children are in our model space once their matrix is applied
+      mBounds = doBounds();
+      mCullable = doCullable();
+      for( auto& c : mChildren ) {
+        if( !c->mEnabled ) continue;
+        mBounds.expand(c->mBounds.transformed(c->matrix()));
+        mCullable = mCullable && c->mCullable;
+      }
     }
 
     void Node::update(Engine& eng, double deltaT)
     {
       if( !mEnabled ) return;
       
-      if( mUpdateScript ) mUpdateScript(eng, *this, deltaT);
+      updateSelf(eng, deltaT);
+      for( auto& c : mChildren ) c->update(eng, deltaT);
+
+      // After the children, so their bounds are up to date
+      updateBounds();
+    }
 
+    void Node::updateSelf(Engine& eng, double deltaT)
+    {
+      if( mUpdateScript ) mUpdateScript(eng, *this, deltaT);
       doUpdate(deltaT);
-      for( auto& c : mChildren ) c->update(eng, deltaT);
+    }
+
+    // Shared by all tasks of a parallel update
+    struct Node::UpdateContext {
+      Engine& eng;
+      double deltaT;
+      JobSystem& jobs;
+      std::mutex errorMutex;
+      std::exception_ptr error;
+    };
+
+    // A chunk of siblings, updated by one job
+    struct Node::UpdateTask {
+      std::vector<Node*> nodes;
+      // Nodes with Global scripts, to be updated on the calling thread
+      std::vector<Node*> deferred;
+      // Chunks of the nodes' children, and their completion (Including bounds)
+      std::vector<std::unique_ptr<UpdateTask>> childTasks;
+      JobSystem::Counter children;
+    };
+
+    void Node::updateParallel(Engine& eng, double deltaT, JobSystem& jobs)
+    {
+      if( !mEnabled ) return;
+
+      UpdateContext context{eng, deltaT, jobs};
+      UpdateTask root;
+      root.nodes.emplace_back(this);
+      JobSystem::Counter done;
+      runUpdateTask(root, context, &done, true);
+      jobs.wait(done);
+      if( context.error ) std::rethrow_exception(context.error);
+
+      // Depth first through the tasks, so the order doesn't depend on scheduling
+      std::vector<Node*> deferred;
+      std::function<void(UpdateTask&)> collect = [&](UpdateTask& t) {
+        deferred.insert(deferred.end(), t.deferred.begin(), t.deferred.end());
+        for( auto& c : t.childTasks ) collect(*c);
+      };
+      collect(root);
+      for( auto n : deferred ) n->update(eng, deltaT);
+    }
+
+    void Node::runUpdateTask(UpdateTask& task, UpdateContext& context, JobSystem::Counter* parentCounter, bool callingThread)
+    {
+      // Siblings per job, enough to outweigh the cost of scheduling
+      const size_t chunkSize = 16u;
+
+      try {
+        for( auto n : task.nodes ) {
+          if( !n->mEnabled ) continue;
+          if( !callingThread && n->mUpdateScript && n->mUpdateScope == ScriptScope::Global ) {
+            task.deferred.emplace_back(n);
+            continue;
+          }
+
+          n->updateSelf(context.eng, context.deltaT);
+
+          UpdateTask* chunk = nullptr;
+          for( auto& c : n->mChildren ) {
+            if( !chunk || chunk->nodes.size() == chunkSize ) {
+              task.childTasks.emplace_back(new UpdateTask());
+              chunk = task.childTasks.back().get();
+            }
+            chunk->nodes.emplace_back(c.get());
+          }
+        }
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(context.errorMutex);
+        if( !context.error ) context.error = std::current_exception();
+      }
+
+      for( auto& c : task.childTasks ) {
+        auto child = c.get();
+        context.jobs.run([child, &context, &task]() {
+          runUpdateTask(*child, context, &task.children, false);
+        }, &task.children);
+      }
+
+      // Bounds once all children (and their children) are complete
+      // parentCounter is incremented here, so the parent can't complete first
+      context.jobs.runAfter(task.children, [&task]() {
+        for( auto n : task.nodes ) {
+          if( !n->mEnabled ) continue;
+          if( std::find(task.deferred.begin(), task.deferred.end(), n) != task.deferred.end() ) continue;
+          n->updateBounds();
+        }
+      }, parentCounter);
     }
     
-    void Node::updateScript(UpdateScript s) { mUpdateScript = s; }
+    void Node::updateScript(UpdateScript s, ScriptScope scope) { mUpdateScript = s; mUpdateScope = scope; }
 
     void Node::cleanup(Renderer& rend) {
 	doCleanup(rend);
@@ -102,15 +390,24 @@
     void Node::doUpdate(double deltaT)
     {
       // Update if our transform is changing over time for some reason
-      mTrans += mTransDelta * (float)deltaT;
-      mRot += mRotDelta * (float)deltaT;
-      mScale += mScaleDelta * (float)deltaT;
+      // Static nodes are left alone, so their matrices remain cached
+      // If bound to a TransformStore the deltas are applied by the store
+      if( mTransforms ) return;
+      if( mTransDelta != vec3(0.0) ) translation(mTrans + mTransDelta * (float)deltaT);
+      if( mRotDelta != vec3(0.0) ) rotation(mRot + mRotDelta * (float)deltaT);
+      if( mScaleDelta != vec3(0.0) ) scale(mScale + mScaleDelta * (float)deltaT);
     }
 
     void Node::doInit(Renderer& rend) {}
     void Node::doUpload(Renderer& rend) {}
     void Node::doRender(Renderer& rend, mat4x4 nodeMat, mat4x4 viewMat, mat4x4 projMat) {}
     void Node::doCleanup(Renderer& rend) {}
+    AABB Node::doBounds() const { return AABB(); }
+    bool Node::doCullable() const {
+      // A plain node renders nothing itself, only its children matter
+      // Subclasses may draw without reporting bounds, so must opt in
+      return typeid(*this) == typeid(Node);
+    }
 
     bool& Node::enabled() { return mEnabled; }
 
@@ -11,12 +11,17 @@
 #include <memory>
 #include <vector>
 #include <functional>
+#include <cstdint>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 using namespace glm;
 
+#include "bounds.h"
+#include "transformstore.h"
+#include "jobsystem.h"
+
 class Renderer;
 class Engine;
 
@@ -42,19 +47,30 @@ public:
 	Children& children();
 
 	// Node transformations
-	vec3& scale();
-	vec3& rotation();
-	vec3& translation();
+	// Setting these marks the node's matrices as dirty
+	const vec3& scale() const;
+	const vec3& rotation() const;
+	const vec3& translation() const;
+	void scale(const vec3& s);
+	void rotation(const vec3& r);
+	void translation(const vec3& t);
 
 	// Node transformation deltas
-	// Will be applied each time render is called
-	vec3& scaleDelta();
-	vec3& rotationDelta();
-	vec3& translationDelta();
+	// Will be applied each time update is called
+	const vec3& scaleDelta() const;
+	const vec3& rotationDelta() const;
+	const vec3& translationDelta() const;
+	void scaleDelta(const vec3& s);
+	void rotationDelta(const vec3& r);
+	void translationDelta(const vec3& t);
 
 	// Model Matrix
-	// Recalculates every time it's called
-	mat4x4 matrix() const;
+	// Cached, only recalculated when the transformation changes
+	const mat4x4& matrix() const;
+
+	// World Matrix, as of the last render traversal
+	// Only recalculated when this node or a parent has changed
+	const mat4x4& worldMatrix() const;
 
 	/**
 	 * Explicit update of model matrix
@@ -63,6 +79,20 @@ public:
 	 * scale/rotation/translation methods, TODO: Does this work? Will this collide and cause weird behaviour?
 	 */
 	void userModelMatrix(mat4x4 mat);
+	const mat4x4& userModelMatrix() const;
+
+	/**
+	 * Bind this node and any children to a TransformStore
+	 *
+	 * The store then holds the transformation, and calculates the matrices
+	 * in its update (Deltas are applied by the store, not Node::update).
+	 * World matrices come from the store's hierarchy, so this should be called
+	 * on the root of the graph, or a node whose parents don't transform.
+	 * Children added after binding keep their own transforms.
+	 */
+	void bindTransforms(TransformStore& store, TransformStore::Index parent = TransformStore::invalidIndex);
+	/// Index within the bound TransformStore, invalidIndex if not bound
+	TransformStore::Index transformIndex() const;
 
 	// Convert a vector in model space to world space
 	// typically used to work out which way 'forward' is
@@ -78,16 +108,55 @@ public:
 	// to allow buffer contents/textures etc to change
 	void upload(Renderer& rend);
 	// Render this node and any children
+	// Subtrees outside of the view frustum are skipped
 	void render(Renderer& rend, mat4x4 viewMat, mat4x4 projMat);
 	void render(Renderer& rend, mat4x4 nodeMat, mat4x4 viewMat, mat4x4 projMat);
 
+	/**
+	 * Render this node and any children, spreading subtrees across the job system
+	 *
+	 * Culling and doRender are performed in parallel, in chunks of siblings,
+	 * so doRender may be called on any thread. The graph must be a tree, a node
+	 * shared between parents could be visited by two threads at once.
+	 *
+	 * Use render for a serial traversal
+	 */
+	void renderParallel(Renderer& rend, mat4x4 viewMat, mat4x4 projMat, JobSystem& jobs);
+
+	/// Bounds of this node and any enabled children, in this node's model space
+	/// Recalculated during update, invalid if the subtree has nothing to render
+	const AABB& bounds() const;
+
+	/// How far the effects of an update script reach
+	enum class ScriptScope {
+		/// May touch anything - Other nodes, the engine, camera, etc
+		Global,
+		/// Only touches this node and its children, may run on any thread
+		Subtree,
+	};
+
 	/// Update this node and any children
 	void update(Engine& eng, double deltaT);
+
+	/**
+	 * Update this node and any children, spreading subtrees across the job system
+	 *
+	 * This node's script runs on the calling thread. Below it nodes are updated
+	 * in parallel, in chunks of siblings. Global scripts found on a worker are
+	 * deferred, along with their subtree, and run on the calling thread once the
+	 * parallel work is complete (In a fixed order). Bounds of the nodes above a
+	 * deferred node will lag by a frame.
+	 *
+	 * Use update for a deterministic serial traversal
+	 */
+	void updateParallel(Engine& eng, double deltaT, JobSystem& jobs);
+
 	/** 
 	 * Assign a script/update function to the node, will be called before
 	 * the call to doUpdate (Before any node-specific updates)
+	 * @param scope What the script touches, determines whether it may be run on a worker thread
 	 */
-	void updateScript(UpdateScript s);
+	void updateScript(UpdateScript s, ScriptScope scope = ScriptScope::Global);
 
 	/// Enable/Disable the node
 	/// Disabled nodes won't be updated or rendered
@@ -109,8 +178,33 @@ public:
 	virtual void doRender(Renderer& rend, mat4x4 nodeMat, mat4x4 viewMat, mat4x4 projMat);
 	virtual void doUpdate(double deltaT);
 	virtual void doCleanup(Renderer& rend);
+	/// Bounds of anything this node renders, in model space
+	/// Doesn't include children, by default empty
+	virtual AABB doBounds() const;
+	/// Whether the node may be skipped when outside the view frustum
+	/// Opt-in: false for subclasses unless overridden, as only nodes
+	/// which report everything they draw in doBounds may be culled
+	virtual bool doCullable() const;
 
 private:
+	void render(Renderer& rend, const mat4x4& parentMat, const void* parent, uint64_t parentVersion, mat4x4 viewMat, mat4x4 projMat, const Frustum& frustum, bool testBounds);
+	/// Cull and render this node, not including children. @return false if the subtree is skipped
+	bool renderSelf(Renderer& rend, const mat4x4& parentMat, const void* parent, uint64_t parentVersion, mat4x4 viewMat, mat4x4 projMat, const Frustum& frustum, bool& testBounds);
+	struct RenderContext;
+	struct RenderItem;
+	static void runRenderTask(std::vector<RenderItem> items, RenderContext& context);
+	/// Recalculate the world matrix if this node or the parent has changed
+	void updateWorldMatrix(const mat4x4& parentMat, const void* parent, uint64_t parentVersion);
+	void transformChanged();
+	/// Recalculate mBounds from this node and its children's bounds
+	void updateBounds();
+
+	/// Run the script and doUpdate, not including children
+	void updateSelf(Engine& eng, double deltaT);
+	struct UpdateContext;
+	struct UpdateTask;
+	static void runUpdateTask(UpdateTask& task, UpdateContext& context, JobSystem::Counter* parentCounter, bool callingThread);
+
 	vec3 mScale = vec3(1.0);
 	vec3 mRot = vec3(0.0);
 	vec3 mTrans = vec3(0.0);
@@ -121,10 +215,37 @@ private:
 
 	mat4x4 mUserModelMat = mat4x4(1.f);
 
+	// Cached local matrix, rebuilt on demand when dirty
+	mutable mat4x4 mLocalMat = mat4x4(1.f);
+	mutable bool mLocalMatDirty = true;
+	// Incremented whenever the local transform changes
+	uint64_t mLocalVersion = 1;
+
+	// Cached world matrix, and what it was calculated from
+	// parent identifies the parent node (or root matrix) and the version of its world matrix
+	// A node shared between parents just recalculates when visited from each
+	mat4x4 mWorldMat = mat4x4(1.f);
+	uint64_t mWorldVersion = 0;
+	const void* mWorldParent = nullptr;
+	uint64_t mWorldParentVersion = 0;
+	uint64_t mWorldLocalVersion = 0;
+	// When rendered as the root of a traversal, the matrix passed to render
+	mat4x4 mRootMat = mat4x4(1.f);
+	uint64_t mRootMatVersion = 1;
+
+	// If set the transformation is held in the store, not the members above
+	TransformStore* mTransforms = nullptr;
+	TransformStore::Index mTransformIndex = TransformStore::invalidIndex;
+
 	Children mChildren;
 
 	bool mEnabled = true;
+
+	// Cached bounds of the subtree, and whether the whole subtree may be culled
+	AABB mBounds;
+	bool mCullable = true;
 	
 	UpdateScript mUpdateScript = {};
+	ScriptScope mUpdateScope = ScriptScope::Global;
 };
 #endif // NODE_H
@@ -0,0 +1,85 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "geometrypool.h"
+
+#include "util/deviceinstance.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+GeometryPool::GeometryPool(DeviceInstance& deviceInstance,
+                           vk::DeviceSize vertexSize,
+                           vk::MemoryPropertyFlags memFlags,
+                           uint32_t verticesPerPage,
+                           uint32_t indicesPerPage)
+  : mDeviceInstance(deviceInstance)
+  , mVertexSize(vertexSize)
+  , mMemFlags(memFlags)
+  , mVerticesPerPage(verticesPerPage)
+  , mIndicesPerPage(indicesPerPage)
+{}
+
+GeometryPool::~GeometryPool() {}
+
+GeometryPool::Handle GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount) {
+  if( vertexCount == 0 || indexCount == 0 ) throw std::runtime_error("GeometryPool::allocate: Meshes must have vertices and indices");
+
+  auto tryPage = [&](uint32_t pageIdx, Handle& handle) {
+    auto& page = *mPages[pageIdx];
+    auto v = page.vertexRanges.allocate(vertexCount);
+    if( v == RangeAllocator::invalidOffset ) return false;
+    auto i = page.indexRanges.allocate(indexCount);
+    if( i == RangeAllocator::invalidOffset ) {
+      page.vertexRanges.free(v, vertexCount);
+      return false;
+    }
+    handle.page = pageIdx;
+    handle.vertexOffset = static_cast<uint32_t>(v);
+    handle.vertexCount = vertexCount;
+    handle.firstIndex = static_cast<uint32_t>(i);
+    handle.indexCount = indexCount;
+    return true;
+  };
+
+  Handle handle;
+  for( auto p = 0u; p < mPages.size(); ++p ) {
+    if( tryPage(p, handle) ) return handle;
+  }
+
+  // No space, add a page - Large meshes get a page to themselves
+  auto page = createPage(std::max(mVerticesPerPage, vertexCount), std::max(mIndicesPerPage, indexCount));
+  if( !tryPage(page, handle) ) throw std::runtime_error("GeometryPool::allocate: Failed to allocate from new page");
+  return handle;
+}
+
+void GeometryPool::free(Handle& handle) {
+  if( !handle.valid() ) return;
+  auto& page = *mPages[handle.page];
+  page.vertexRanges.free(handle.vertexOffset, handle.vertexCount);
+  page.indexRanges.free(handle.firstIndex, handle.indexCount);
+  handle = Handle();
+}
+
+uint32_t GeometryPool::createPage(uint32_t numVertices, uint32_t numIndices) {
+  std::unique_ptr<Page> page(new Page(numVertices, numIndices));
+  page->vertices.reset(new SimpleBuffer(
+    mDeviceInstance,
+    numVertices * mVertexSize,
+    vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    mMemFlags));
+  page->vertices->name() = "GeometryPool::vertices";
+  page->indices.reset(new SimpleBuffer(
+    mDeviceInstance,
+    numIndices * indexSize,
+    vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    mMemFlags));
+  page->indices->name() = "GeometryPool::indices";
+
+  mPages.emplace_back(std::move(page));
+  return static_cast<uint32_t>(mPages.size() - 1);
+}
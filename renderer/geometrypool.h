@@ -0,0 +1,91 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef GEOMETRYPOOL_H
+#define GEOMETRYPOOL_H
+
+#include "util/simplebuffer.h"
+#include "util/rangeallocator.h"
+
+#include <memory>
+#include <vector>
+
+class DeviceInstance;
+
+/**
+ * Storage for mesh geometry
+ * - Vertices and indices are sub-allocated from a few large buffers (pages)
+ * - Meshes only hold a handle, draws select their geometry
+ *   through firstIndex/vertexOffset
+ * - Draws from the same page share a single vertex/index buffer binding
+ *
+ * A page holds a fixed number of vertices/indices, meshes which
+ * don't fit in a regular page are given a page of their own.
+ */
+class GeometryPool
+{
+public:
+  /// Location of a mesh's geometry within the pool
+  struct Handle {
+    uint32_t page = 0;
+    uint32_t vertexOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+
+    bool valid() const { return indexCount > 0; }
+  };
+
+  /**
+   * @param vertexSize Size of a vertex in bytes
+   * @param memFlags Memory flags for the page buffers
+   */
+  GeometryPool(DeviceInstance& deviceInstance,
+               vk::DeviceSize vertexSize,
+               vk::MemoryPropertyFlags memFlags,
+               uint32_t verticesPerPage = 1u << 20,
+               uint32_t indicesPerPage = 1u << 22);
+  ~GeometryPool();
+
+  /// Allocate space for a mesh, contents of the ranges are undefined until uploaded
+  Handle allocate(uint32_t vertexCount, uint32_t indexCount);
+  /// Release a mesh's geometry, the handle is reset
+  void free(Handle& handle);
+
+  SimpleBuffer& vertexBuffer(uint32_t page) { return *mPages[page]->vertices; }
+  SimpleBuffer& indexBuffer(uint32_t page) { return *mPages[page]->indices; }
+  uint32_t pageCount() const { return static_cast<uint32_t>(mPages.size()); }
+
+  vk::DeviceSize vertexSize() const { return mVertexSize; }
+  static const vk::DeviceSize indexSize = sizeof(uint32_t);
+
+private:
+  GeometryPool() = delete;
+
+  struct Page {
+    std::unique_ptr<SimpleBuffer> vertices;
+    std::unique_ptr<SimpleBuffer> indices;
+    // In units of vertices/indices
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+
+    Page(uint32_t numVertices, uint32_t numIndices)
+      : vertexRanges(numVertices), indexRanges(numIndices) {}
+  };
+
+  uint32_t createPage(uint32_t numVertices, uint32_t numIndices);
+
+  DeviceInstance& mDeviceInstance;
+  vk::DeviceSize mVertexSize;
+  vk::MemoryPropertyFlags mMemFlags;
+  uint32_t mVerticesPerPage;
+  uint32_t mIndicesPerPage;
+
+  std::vector<std::unique_ptr<Page>> mPages;
+};
+
+#endif
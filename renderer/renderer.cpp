@@ -1,19 +1,43 @@
 #include "renderer.h"
 #include "engine.h"
 
+#include <algorithm>
 #include <mutex>
 #include <functional>
 
+#ifdef EMBED_SHADERS
+# include <cstdint>
+# include <span>
+// Generated by compile_shader
+# include "mesh.vert.h"
+# include "flatshading.frag.h"
+# include "phongish.frag.h"
+# include "cull.comp.h"
+
+namespace {
+  const std::map<std::string, std::span<const uint32_t>> embeddedShaders = {
+    {"mesh.vert.spv", mesh_vert_spv},
+    {"flatshading.frag.spv", flatshading_frag_spv},
+    {"phongish.frag.spv", phongish_frag_spv},
+    {"cull.comp.spv", cull_comp_spv},
+  };
+}
+#endif
+
 using namespace std::placeholders;
 
-Renderer::Renderer(Engine& engine)
-  : mEngine(engine) {}
+Renderer::Renderer(Engine& engine, bool headless)
+  : mEngine(engine)
+  , mHeadless(headless) {}
 
 Renderer::~Renderer() {
   cleanup();
 }
 
 void Renderer::initWindow() {
+  // Nothing to do if rendering offscreen
+  if( mHeadless ) return;
+
   // TODO: This should be in a separate class - Renderer shouldn't be tied to one window system
   glfwInit();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -51,10 +75,13 @@ void Renderer::onGLFWFramebufferSize(int width, int height) {
 void Renderer::initVK() {
   // Initialise the vulkan instance
   // GLFW can give us what extensions it requires, nice
-  uint32_t glfwExtensionCount = 0;
-  const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+  // If headless we don't need any, as we won't be presenting to a surface
   std::vector<const char*> requiredExtensions;
-  for (uint32_t i = 0; i < glfwExtensionCount; ++i) requiredExtensions.push_back(glfwExtensions[i]);
+  if( !mHeadless ) {
+    uint32_t glfwExtensionCount = 0;
+    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    for (uint32_t i = 0; i < glfwExtensionCount; ++i) requiredExtensions.push_back(glfwExtensions[i]);
+  }
 
   // Just the one queue here for rendering
   std::vector<vk::QueueFlags> requiredQueues = { vk::QueueFlagBits::eGraphics };
@@ -62,21 +89,56 @@ void Renderer::initVK() {
   mQueue = mDeviceInstance->getQueue(requiredQueues[0]);
   if (!mQueue) throw std::runtime_error("Failed to get graphics queue from device");
 
+  // Pipelines are built from the previous run's cache if possible, saved in cleanup
+  if( !mPipelineCacheDirectory.empty() ) mDeviceInstance->loadPipelineCache(mPipelineCacheDirectory);
+
   // Find out what queues are available
   //auto queueFamilyProps = dev.getQueueFamilyProperties();
   //printQueueFamilyProperties(queueFamilyProps);
 
+  // Uploads use the dedicated transfer queue if there is one, so copies can
+  // run alongside rendering. Otherwise they're performed on the graphics queue
+  auto transferQueue = mDeviceInstance->transferQueue();
+  mUploadBatcher.reset(new UploadBatcher(*mDeviceInstance.get(), transferQueue ? *transferQueue : *mQueue, mQueue));
+  mGeometryPool.reset(new GeometryPool(*mDeviceInstance.get(), sizeof(Vertex), geometryMemoryFlags()));
+
+  // Draws are issued from a buffer if supported, otherwise recorded one at a time
+  // firstInstance must be usable in indirect commands, it's the offset into the instance buffer
+  auto& features = mDeviceInstance->enabledFeatures();
+  mIndirectDraws = features.drawIndirectFirstInstance;
+  mMultiDrawIndirect = mIndirectDraws && features.multiDrawIndirect;
+  mMaxDrawIndirectCount = mMultiDrawIndirect ? mDeviceInstance->physicalDevice().getProperties().limits.maxDrawIndirectCount : 1u;
+
+  // Per-frame data is sub-allocated from a single buffer, bound with dynamic offsets
+  auto& limits = mDeviceInstance->physicalDevice().getProperties().limits;
+  mUniformAlignment = std::max(vk::DeviceSize(1), limits.minUniformBufferOffsetAlignment);
+  mStorageAlignment = std::max(vk::DeviceSize(1), limits.minStorageBufferOffsetAlignment);
+
+  // Textures are bindless if supported, the table's size is baked into the pipeline
+  initTextureTable();
+
+  // Instances are culled by a compute pass writing the indirect commands
+  // Recorded into the frame's command buffer, so the queue must support compute
+  auto qFamProps = mDeviceInstance->physicalDevice().getQueueFamilyProperties();
+  mGpuCulling = mIndirectDraws && (qFamProps[mQueue->famIndex].queueFlags & vk::QueueFlagBits::eCompute);
+  mGraphicsSpecConstants.gpuCulling = mGpuCulling ? VK_TRUE : VK_FALSE;
+
   createSwapChainAndGraphicsPipeline();
+  if( mGpuCulling ) createCullPipeline();
 
   // Setup per-image primitives
   // This data is assigned one for each swapchain image (which may be different to mMaxFramesInFlight)
   mPerImageData.resize(mWindowIntegration->swapChainSize());
   // Create descriptor pools
   initDescriptorSetsForRenderer();
-  initDescriptorSetsForMeshes();
-  // Create UBOs & descriptors for per-image data and any associated defaults
+  // Materials are added as they're rendered, start with enough for a reasonable scene
+  createMaterialBuffer(256u);
+  // Create frame allocators & descriptors for per-image data
   createDescriptorSetsForRenderer();
-  createDefaultDescriptorSetForMesh();
+  createDefaultTexture();
+  // Created up front, as meshes may be rendered from multiple threads
+  mDefaultMaterial.reset(new Material());
+  createTimestampQueries();
 
   // Setup our sync primitives
   // imageAvailable - gpu: Used to stall the pipeline until the presentation has finished reading from the image
@@ -96,19 +158,48 @@ void Renderer::createSwapChainAndGraphicsPipeline() {
   // Create a logical device to interact with
   // To do this we also need to specify how many queues from which families we want to create
   // In this case just 1 queue from the first family which supports graphics
-  mWindowIntegration.reset(new WindowIntegration(mWindow, *mDeviceInstance.get(), *mQueue, vk::SampleCountFlagBits::e64));
+  if( mHeadless ) {
+    vk::Extent2D extent(static_cast<uint32_t>(mWindowWidth), static_cast<uint32_t>(mWindowHeight));
+    mWindowIntegration.reset(new WindowIntegration(*mDeviceInstance.get(), *mQueue, vk::SampleCountFlagBits::e64, extent, mHeadlessImageCount));
+  } else {
+    mWindowIntegration.reset(new WindowIntegration(mWindow, *mDeviceInstance.get(), *mQueue, vk::SampleCountFlagBits::e64));
+  }
+
+  createGraphicsPipeline();
+
+  mFrameBuffer.reset(new FrameBuffer(mDeviceInstance->device(), *mWindowIntegration.get(), mGraphicsPipeline->renderPass()));
 
+  // Create our command pool (So we can make command buffers
+  // eResetCommandBuffer - Buffers can be reset/re-used individually, instead of needing to reset the whole pool
+  mCommandPool = mDeviceInstance->createCommandPool({ vk::CommandPoolCreateFlagBits::eResetCommandBuffer }, *mQueue);
+  createCommandBuffers();
+  createSecondaryCommandPools();
+}
+
+void Renderer::createCommandBuffers() {
+  // A primary command buffer for each swapchain image
+  mCommandBuffers.clear();
+  auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
+    .setCommandPool(mCommandPool.get())
+    .setCommandBufferCount(static_cast<uint32_t>(mWindowIntegration->swapChainSize()))
+    .setLevel(vk::CommandBufferLevel::ePrimary);
+  mCommandBuffers = mDeviceInstance->device().allocateCommandBuffersUnique(commandBufferAllocateInfo);
+}
+
+void Renderer::createGraphicsPipeline() {
   // Create the pipeline, with a flag to invert the viewport height (Switch to left handed coordinate system)
   // If changing this check the compile flags for GLM_FORCE_LEFT_HANDED - The rest of the engine uses one cs
   // and the renderer should handle it
   mGraphicsPipeline.reset(new GraphicsPipeline(*mWindowIntegration.get(), *mDeviceInstance.get(), true));
+  // Viewport is set while recording, so the pipeline survives swapchain resizes
+  mGraphicsPipeline->dynamicViewport(true);
 
   // Build the graphics pipeline
   // In this case we can throw away the shader modules after building as they're only used by the one pipeline
   {
-    mGraphicsPipeline->shaders()[vk::ShaderStageFlagBits::eVertex] = mGraphicsPipeline->createShaderModule(std::string(RENDERER_SHADER_ROOT) + "/mesh.vert.spv");
-    // mGraphicsPipeline->shaders()[vk::ShaderStageFlagBits::eFragment] = mGraphicsPipeline->createShaderModule(std::string(RENDERER_SHADER_ROOT) + "/flatshading.frag.spv");
-    mGraphicsPipeline->shaders()[vk::ShaderStageFlagBits::eFragment] = mGraphicsPipeline->createShaderModule(std::string(RENDERER_SHADER_ROOT) + "/phongish.frag.spv");
+    mGraphicsPipeline->shaders()[vk::ShaderStageFlagBits::eVertex] = createShaderModule(*mGraphicsPipeline, "mesh.vert.spv");
+    // mGraphicsPipeline->shaders()[vk::ShaderStageFlagBits::eFragment] = createShaderModule(*mGraphicsPipeline, "flatshading.frag.spv");
+    mGraphicsPipeline->shaders()[vk::ShaderStageFlagBits::eFragment] = createShaderModule(*mGraphicsPipeline, "phongish.frag.spv");
 
     // The layout of our vertex buffers
     auto vertBufferBinding = vk::VertexInputBindingDescription()
@@ -124,40 +215,92 @@ void Renderer::createSwapChainAndGraphicsPipeline() {
     mGraphicsPipeline->vertexInputAttributes().emplace_back(3, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, uv0));
 
     // Register the Descriptor set layouts on the pipeline
-    mGraphicsPipeline->addDescriptorSetLayoutBinding(0, 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAllGraphics);
-    mGraphicsPipeline->addDescriptorSetLayoutBinding(1, 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAllGraphics);
-
-    // Register the push constant blocks
-    mPushConstantSetRange = vk::PushConstantRange()
-      .setStageFlags(vk::ShaderStageFlagBits::eVertex)
-      .setOffset(0)
-      .setSize(sizeof(PushConstantSet));
-    mGraphicsPipeline->pushConstants().emplace_back(mPushConstantSetRange);
+    addPerFrameDescriptorSetLayout(*mGraphicsPipeline);
+    addTextureDescriptorSetLayout(*mGraphicsPipeline);
 
     // Setup specialisation constants
+    // Constants are looked up per-stage, so each stage needs its own entry
     vk::SpecializationMapEntry specs[] = {
       {0, offsetof(GraphicsSpecConstants, maxLights), sizeof(uint32_t)},
+      {1, offsetof(GraphicsSpecConstants, gpuCulling), sizeof(VkBool32)},
+      {2, offsetof(GraphicsSpecConstants, maxTextures), sizeof(uint32_t)},
     };
-    mGraphicsPipeline->specialisationConstants()[vk::ShaderStageFlagBits::eAllGraphics] = vk::SpecializationInfo(1, specs, sizeof(GraphicsSpecConstants), &mGraphicsPipeline);
+    auto specInfo = vk::SpecializationInfo(3, specs, sizeof(GraphicsSpecConstants), &mGraphicsSpecConstants);
+    mGraphicsPipeline->specialisationConstants()[vk::ShaderStageFlagBits::eVertex] = specInfo;
+    mGraphicsPipeline->specialisationConstants()[vk::ShaderStageFlagBits::eFragment] = specInfo;
 
     // Finally build the pipeline
     mGraphicsPipeline->build();
   }
+}
 
-  mFrameBuffer.reset(new FrameBuffer(mDeviceInstance->device(), *mWindowIntegration.get(), mGraphicsPipeline->renderPass()));
+void Renderer::createSecondaryCommandPools() {
+  // Buffers are re-recorded when the image's primary is, the whole pool is reset at once
+  // recordSecondaryCommandBuffers splits a frame into at most 2 chunks per thread
+  auto numChunks = (mEngine.jobs().workerCount() + 1) * 2;
+  mSecondaryCommandData.clear();
+  mSecondaryCommandData.resize(mWindowIntegration->swapChainSize());
+  for( auto& imageData : mSecondaryCommandData ) {
+    imageData.resize(numChunks);
+    for( auto& chunkData : imageData ) {
+      chunkData.pool = mDeviceInstance->createCommandPool({ vk::CommandPoolCreateFlagBits::eTransient }, *mQueue);
+    }
+  }
+}
 
-  // Create our command pool (So we can make command buffers
-  // eResetCommandBuffer - Buffers can be reset/re-used individually, instead of needing to reset the whole pool
-  mCommandPool = mDeviceInstance->createCommandPool({ vk::CommandPoolCreateFlagBits::eResetCommandBuffer }, *mQueue);
-  // Now make a command buffer for each swapchain image
-  auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
-    .setCommandPool(mCommandPool.get())
-    .setCommandBufferCount(static_cast<uint32_t>(mWindowIntegration->swapChainSize()))
-    .setLevel(vk::CommandBufferLevel::ePrimary);
-  mCommandBuffers = mDeviceInstance->device().allocateCommandBuffersUnique(commandBufferAllocateInfo);
+void Renderer::addPerFrameDescriptorSetLayout(Pipeline& pipeline) {
+  // 0 - Per-frame UBO
+  // 1 - Instance data
+  // 2 - Indirect draw commands, written by the culling pass
+  // 3 - Indices of the visible instances, written by the culling pass
+  // 4 - Material data, indexed by the instance's materialIndex
+  // 0-2 are in the image's frame allocator, with dynamic offsets
+  pipeline.addDescriptorSetLayoutBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute);
+  pipeline.addDescriptorSetLayoutBinding(0, 1, vk::DescriptorType::eStorageBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute);
+  pipeline.addDescriptorSetLayoutBinding(0, 2, vk::DescriptorType::eStorageBufferDynamic, 1, vk::ShaderStageFlagBits::eCompute);
+  pipeline.addDescriptorSetLayoutBinding(0, 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute);
+  pipeline.addDescriptorSetLayoutBinding(0, 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment);
+}
+
+void Renderer::addTextureDescriptorSetLayout(Pipeline& pipeline) {
+  // 0 - Texture table, mMaxTextures is an upper bound if bindless, the set's size is given when allocated
+  vk::DescriptorBindingFlagsEXT flags = {};
+  if( mBindlessTextures ) {
+    flags = vk::DescriptorBindingFlagBitsEXT::ePartiallyBound |
+            vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+            vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending |
+            vk::DescriptorBindingFlagBitsEXT::eVariableDescriptorCount;
+  }
+  pipeline.addDescriptorSetLayoutBinding(1, 0, vk::DescriptorType::eCombinedImageSampler, mMaxTextures, vk::ShaderStageFlagBits::eFragment, flags);
 }
 
-void Renderer::reCreateSwapChainAndGraphicsPipeline() {
+void Renderer::createCullPipeline() {
+  // Independent of the swapchain, created once
+  mCullPipeline.reset(new ComputePipeline(*mDeviceInstance.get()));
+  mCullPipeline->shaders()[vk::ShaderStageFlagBits::eCompute] = createShaderModule(*mCullPipeline, "cull.comp.spv");
+
+  addPerFrameDescriptorSetLayout(*mCullPipeline);
+  mCullPipeline->pushConstants().emplace_back(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants));
+
+  vk::SpecializationMapEntry specs[] = {
+    {0, offsetof(GraphicsSpecConstants, maxLights), sizeof(uint32_t)},
+  };
+  mCullPipeline->specialisationConstants()[vk::ShaderStageFlagBits::eCompute] = vk::SpecializationInfo(1, specs, sizeof(GraphicsSpecConstants), &mGraphicsSpecConstants);
+
+  mCullPipeline->build();
+}
+
+vk::UniqueShaderModule Renderer::createShaderModule(Pipeline& pipeline, const std::string& fileName) {
+#ifdef EMBED_SHADERS
+  auto it = embeddedShaders.find(fileName);
+  if( it == embeddedShaders.end() ) throw std::runtime_error("Renderer::createShaderModule: Shader not embedded: " + fileName);
+  return pipeline.createShaderModule(it->second);
+#else
+  return pipeline.createShaderModule(std::string(RENDERER_SHADER_ROOT) + "/" + fileName);
+#endif
+}
+
+void Renderer::reCreateSwapChain() {
   // Handle minimisation (size == 0)
   // Also just refresh the size, just incase it's out of date
   glfwGetFramebufferSize(mWindow, &mWindowWidth, &mWindowHeight);
@@ -166,23 +309,51 @@ void Renderer::reCreateSwapChainAndGraphicsPipeline() {
     glfwWaitEvents();
   }
 
-  // Perform a partial teardown and recreate (to hand window resize/similar)
-  // This method should clean up anything that's created in createSwapChainAndGraphicsPipeline
-  // TODO: It's possible/more efficient to create a new swapchain while we're still rendering
-  // For now just halt everything and recreate from scratch
-  mDeviceInstance->waitAllDevicesIdle();
+  // Only the frames in flight reference the swapchain images and attachments,
+  // so wait for those rather than the whole device (Uploads may still be running)
+  std::vector<vk::Fence> fences;
+  for( auto& frameData : mPerFrameData ) fences.emplace_back(frameData.renderFinishedFence.get());
+  mDeviceInstance->device().waitForFences(static_cast<uint32_t>(fences.size()), fences.data(), true, std::numeric_limits<uint64_t>::max());
+  // Every frame before the one being built has been rendered, and any submissions are complete
+  if( mBuildSerial > 0 ) mDeletionQueue.collect(mBuildSerial - 1);
+
+  // The pipeline, command buffers and per-image data are independent of the
+  // swapchain's size, only the swapchain, attachments and framebuffers are rebuilt
+  auto oldFormat = mWindowIntegration->swapChainFormat();
+  auto oldSize = mWindowIntegration->swapChainSize();
+  mFrameBuffer.reset();
+  // Presents from the old swapchain may still be pending, the fences above don't cover them
+  releaseResource(mWindowIntegration->recreateSwapChain(*mQueue));
 
-//  mPerImageData.clear();
+  // Render pass depends on the format, which is very unlikely to change
+  if( mWindowIntegration->swapChainFormat() != oldFormat ) {
+    mGraphicsPipeline.reset();
+    createGraphicsPipeline();
+  }
 
-  mCommandBuffers.clear();
-  // TODO: Don't actually need to recreate the pool
-  mCommandPool.reset();
+  // The driver may return a different number of images, anything per-image must follow
+  if( mWindowIntegration->swapChainSize() != oldSize ) rebuildPerImageData();
 
-  mGraphicsPipeline.reset();
-  mFrameBuffer.reset();
-  mWindowIntegration.reset();
+  mFrameBuffer.reset(new FrameBuffer(mDeviceInstance->device(), *mWindowIntegration.get(), mGraphicsPipeline->renderPass()));
 
-  createSwapChainAndGraphicsPipeline();
+  // Command buffers reference the old framebuffers, all must be re-recorded
+  for( auto& imageData : mPerImageData ) imageData.recorded = RecordedState();
+}
+
+void Renderer::rebuildPerImageData() {
+  // Only called once all frames have completed, nothing references the old data
+  if( !mBindlessTextures ) {
+    for( auto& imageData : mPerImageData ) mTextureDescriptors->free(imageData.textureSet);
+  }
+  mPerImageData.clear();
+  mDescriptorAllocator->reset();
+
+  mPerImageData.resize(mWindowIntegration->swapChainSize());
+  createDescriptorSetsForRenderer();
+  createCommandBuffers();
+  createSecondaryCommandPools();
+  mTimestampQueryPool.reset();
+  createTimestampQueries();
 }
 
 void Renderer::buildCommandBuffer(vk::CommandBuffer& commandBuffer, const vk::Framebuffer& frameBuffer) {
@@ -194,6 +365,19 @@ void Renderer::buildCommandBuffer(vk::CommandBuffer& commandBuffer, const vk::Fr
     ;
   commandBuffer.begin(beginInfo);
 
+  // Timestamp at the start of the frame
+  auto queryIndex = mCurrentFrameData.imageIndex * 2u;
+  if( mTimestampQueryPool ) {
+    commandBuffer.resetQueryPool(mTimestampQueryPool.get(), queryIndex, 2);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, mTimestampQueryPool.get(), queryIndex);
+  }
+
+  if( mGpuCulling ) recordCulling(commandBuffer);
+
+  // Large frames are recorded in parallel, into secondary command buffers
+  auto numGroups = static_cast<uint32_t>(mCurrentFrameData.drawGroups.size());
+  auto parallelRecord = useParallelRecording();
+
   // Start the render pass
   // Clear colour/depth buffers at the start
   std::array<vk::ClearValue, 2> clearVals;
@@ -209,337 +393,634 @@ void Renderer::buildCommandBuffer(vk::CommandBuffer& commandBuffer, const vk::Fr
   renderPassInfo.renderArea.offset = vk::Offset2D(0, 0);
   renderPassInfo.renderArea.extent = mWindowIntegration->swapChainExtent();
 
-  // render commands will be embedded in primary buffer and no secondary command buffers
-  // will be executed
-  commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-
-  // Bind the graphics pipeline
-  commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, mGraphicsPipeline->pipeline());
-
-  // Update the per-frame UBO
-  UBOSetPerFrame pfData;
-  pfData.viewMatrix = mCurrentFrameData.viewMatrix;
-  pfData.projectionMatrix = mCurrentFrameData.projectionMatrix;
-  pfData.eyePos = glm::vec4(mCurrentFrameData.eyePos, 1.0);
-  for( auto lI = 0u; lI < mCurrentFrameData.lightsToRender.size(); ++lI ) {
-      pfData.lights[lI] = mCurrentFrameData.lightsToRender[lI];
-    }
-  // std::memcpy(pfData.lights, mLightsToRender.data(), mLightsToRender.size() * sizeof(ShaderLightData));
-  pfData.numLights = mCurrentFrameData.lightsToRender.size();
-
-  auto& pfUBO = imageData.ubo;
-  std::memcpy(pfUBO->map(), &pfData, sizeof(UBOSetPerFrame));
-  pfUBO->flush();
-  pfUBO->unmap(); // TODO: Shouldn't actually being unmapping here, the buffer will stick around so this is unecesarry
-
-  // And bind it to the pipeline
-  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-    mGraphicsPipeline->pipelineLayout(),
-    0, 1,
-    &imageData.uboDescriptor,
-    0, nullptr);
-
-  // Iterate over the meshes we need to render
-  // TODO: This is a tad messy here - Should certainly
-  // collate the materials into one big UBO, allow
-  // meshes to dynamically add/remove from the scene etc.
-  for (auto& mesh : mCurrentFrameData.meshesToRender) {
-    // Bind the descriptor set for the mesh
-    // Static mesh data such as Material, textures, etc
-    auto meshData = mMeshRenderData.find(mesh.mesh);
-    if (meshData != mMeshRenderData.end()) {
-      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-        mGraphicsPipeline->pipelineLayout(),
-        1, 1,
-        &meshData->second.descriptorSet,
-        0, nullptr);
-    }
-    else
-    {
-      // Bind the default material
-      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-        mGraphicsPipeline->pipelineLayout(),
-        1, 1,
-        &mDescriptorSetMeshDataDefault,
-        0, nullptr);
-    }
-
-    // Set push constants - Data that changes often
-    // or over time such as the model matrix
-    PushConstantSet puush;
-    puush.modelMatrix = mesh.modelMatrix;
-    commandBuffer.pushConstants(
+  if( parallelRecord ) {
+    // All commands within the render pass are in the secondary buffers
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+    auto secondaries = recordSecondaryCommandBuffers(frameBuffer);
+    commandBuffer.executeCommands(static_cast<uint32_t>(secondaries.size()), secondaries.data());
+  } else {
+    // render commands will be embedded in primary buffer and no secondary command buffers
+    // will be executed
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+
+    // Bind the graphics pipeline
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, mGraphicsPipeline->pipeline());
+    mGraphicsPipeline->setViewport(commandBuffer, mWindowIntegration->swapChainExtent());
+
+    // And bind the per-frame UBO and texture table to the pipeline
+    vk::DescriptorSet sets[] = { imageData.uboDescriptor, currentTextureSet() };
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
       mGraphicsPipeline->pipelineLayout(),
-      mPushConstantSetRange.stageFlags,
-      mPushConstantSetRange.offset,
-      sizeof(PushConstantSet),
-      &puush);
-
-    // Set vertex buffer
-    auto& vertBuf = mesh.mesh->mVertexBuffer;
-    // TODO: Probably not efficient - Should batch multiple buffers/offsets here, probably based on shared materials
-    vk::Buffer buffers[] = { vertBuf->buffer() };
-    vk::DeviceSize offsets[] = { 0 };
-    commandBuffer.bindVertexBuffers(0, 1, buffers, offsets);
-
-    auto& idxBuf = mesh.mesh->mIndexBuffer;
-    // If there's no index buffer just draw all the vertices
-    if (!idxBuf) {
-      commandBuffer.draw(static_cast<uint32_t>(vertBuf->size() / sizeof(Vertex)), // Draw n vertices
-        1, // Used for instanced rendering, 1 otherwise
-        0, // First vertex
-        0  // First instance
-      );
-    }
-    else {
-      // Set index buffer
-      commandBuffer.bindIndexBuffer(idxBuf->buffer(), 0, vk::IndexType::eUint32);
+      0, 2,
+      sets,
+      static_cast<uint32_t>(mCurrentFrameData.perFrameOffsets.size()), mCurrentFrameData.perFrameOffsets.data());
 
-      // Draw
-      commandBuffer.drawIndexed(static_cast<uint32_t>(idxBuf->size() / sizeof(uint32_t)), 1, 0, 0, 0);
-    }
+    recordDraws(commandBuffer, 0, numGroups);
   }
 
   // End the render pass
   commandBuffer.endRenderPass();
 
+  // And at the end of the frame
+  if( mTimestampQueryPool ) {
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, mTimestampQueryPool.get(), queryIndex + 1);
+  }
+
   // End the command buffer
   commandBuffer.end();
 }
 
-void Renderer::initDescriptorSetsForRenderer() {
+void Renderer::updatePerFrameUBO() {
+  // Written every frame, whether or not the command buffer is re-recorded
+  // The frame's range of the frame allocator is mapped, write straight into it
+  auto& snapshot = *mCurrentFrameData.snapshot;
+  auto& imageData = mPerImageData[mCurrentFrameData.imageIndex];
+  auto pfData = static_cast<UBOSetPerFrame*>(mCurrentFrameData.uboRange.data);
+  pfData->viewMatrix = snapshot.viewMatrix;
+  pfData->projectionMatrix = snapshot.projectionMatrix;
+  pfData->eyePos = glm::vec4(snapshot.eyePos, 1.0);
+  pfData->numLights = snapshot.lightsToRender.size();
+  if( !snapshot.lightsToRender.empty() ) {
+    std::memcpy(pfData->lights, snapshot.lightsToRender.data(), snapshot.lightsToRender.size() * sizeof(ShaderLightData));
+  }
 
-  // Create a descriptor pool, to allocate descriptor sets for per-frame data
-  // Just need to be able to pass one UBO for now, but as we'll have multiple
-  // frames in flight we'll have several copies of the buffer
-  auto poolSize = vk::DescriptorPoolSize()
-    .setType(vk::DescriptorType::eUniformBuffer)
-    .setDescriptorCount(mPerImageData.size());
+  // Lights past numLights aren't read, so only flush what was written
+  imageData.frameData->flush(mCurrentFrameData.uboRange, 0, offsetof(UBOSetPerFrame, lights) + snapshot.lightsToRender.size() * sizeof(ShaderLightData));
+}
 
-  auto poolInfo = vk::DescriptorPoolCreateInfo()
-    .setFlags({})
-    .setMaxSets(mPerImageData.size())
-    .setPoolSizeCount(1)
-    .setPPoolSizes(&poolSize);
-  mDescriptorPoolRenderer = mDeviceInstance->device().createDescriptorPoolUnique(poolInfo);
+bool Renderer::useParallelRecording() const {
+  auto numGroups = static_cast<uint32_t>(mCurrentFrameData.drawGroups.size());
+  return mEngine.jobs().workerCount() > 0 && numGroups >= 2 * MIN_DRAWS_PER_SECONDARY;
+}
+
+void Renderer::captureRecordedState(RecordedState& state, const vk::Framebuffer& frameBuffer) const {
+  auto& imageData = mPerImageData[mCurrentFrameData.imageIndex];
+  state.valid = true;
+  state.pipeline = mGraphicsPipeline->pipeline();
+  state.frameBuffer = frameBuffer;
+  state.textureSet = currentTextureSet();
+  state.descriptorGeneration = imageData.descriptorGeneration;
+  state.perFrameOffsets = mCurrentFrameData.perFrameOffsets;
+  state.instanceCount = mGpuCulling ? static_cast<uint32_t>(mCurrentFrameData.snapshot->meshesToRender.size()) : 0u;
+  state.parallel = useParallelRecording();
+
+  // Indirect draw parameters are read from the buffer, so only the
+  // bindings matter. Otherwise each draw's parameters are in the commands
+  auto& groups = mCurrentFrameData.drawGroups;
+  state.draws.resize(groups.size());
+  for( auto g = 0u; g < groups.size(); ++g ) {
+    auto& geom = groups[g].geometry;
+    auto& draw = state.draws[g];
+    draw = DrawSignature();
+    draw.page = geom.page;
+    if( !mIndirectDraws ) {
+      draw.indexCount = geom.indexCount;
+      draw.firstIndex = geom.firstIndex;
+      draw.vertexOffset = static_cast<int32_t>(geom.vertexOffset);
+      draw.firstInstance = groups[g].firstInstance;
+      draw.instanceCount = groups[g].instanceCount;
+    }
+  }
+}
+
+void Renderer::createTimestampQueries() {
+  // Timestamps are optional in the spec, only used for stats so skip them if needed
+  auto limits = mDeviceInstance->physicalDevice().getProperties().limits;
+  auto qFamProps = mDeviceInstance->physicalDevice().getQueueFamilyProperties();
+  if( !limits.timestampComputeAndGraphics || qFamProps[mQueue->famIndex].timestampValidBits == 0 ) {
+    std::cerr << "Renderer: Timestamp queries not supported, gpu frame times won't be available" << std::endl;
+    return;
+  }
+  mTimestampPeriod = limits.timestampPeriod;
+
+  auto info = vk::QueryPoolCreateInfo()
+    .setQueryType(vk::QueryType::eTimestamp)
+    .setQueryCount(static_cast<uint32_t>(mPerImageData.size() * 2));
+  mTimestampQueryPool = mDeviceInstance->device().createQueryPoolUnique(info);
+}
+
+void Renderer::readTimestampQueries(uint32_t imageIndex) {
+  // Called once the image's last frame has finished, so results will be available
+  auto& imageData = mPerImageData[imageIndex];
+  if( !mTimestampQueryPool || !imageData.timestampsWritten ) return;
+
+  std::array<uint64_t, 2> timestamps = {0u, 0u};
+  auto res = mDeviceInstance->device().getQueryPoolResults(
+    mTimestampQueryPool.get(), imageIndex * 2u, 2,
+    sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+    vk::QueryResultFlagBits::e64);
+  if( res != vk::Result::eSuccess ) return;
+
+  auto gpuTime = static_cast<double>(timestamps[1] - timestamps[0]) * mTimestampPeriod / 1.0e6;
+  mFrameStats.lastGpuFrameTime = gpuTime;
+  mFrameStats.totalGpuFrameTime += gpuTime;
+  mFrameStats.gpuFramesTimed++;
+}
+
+void Renderer::initDescriptorSetsForRenderer() {
+  auto numImages = static_cast<uint32_t>(mPerImageData.size());
+
+  // Descriptor sets for per-frame data
+  // One UBO and the instance/indirect/visibility/material SSBOs, but as we'll have multiple
+  // frames in flight we'll have several copies of the buffers
+  mDescriptorAllocator.reset(new DescriptorAllocator(*mDeviceInstance.get(), {
+    vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1),
+    vk::DescriptorPoolSize(vk::DescriptorType::eStorageBufferDynamic, 2),
+    vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 2),
+  }, numImages));
+
+  // Texture tables, either a single variable sized set or one full size set per image
+  if( mBindlessTextures ) {
+    mTextureDescriptors.reset(new DescriptorAllocator(*mDeviceInstance.get(), {
+      vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1),
+    }, 1u, vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT));
+  } else {
+    mTextureDescriptors.reset(new DescriptorAllocator(*mDeviceInstance.get(), {
+      vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, mMaxTextures),
+    }, numImages));
+  }
 }
 
 void Renderer::createDescriptorSetsForRenderer() {
   // Create the descriptor sets
   // These ones are created once and remain for the renderer's lifetime
-  // Data in the UBOs will change, after synchronising with the pipeline
+  // Data in the frame allocators will change, after synchronising with the pipeline
 
-  std::vector<vk::DescriptorSetLayout> dsLayouts;
-  for( auto i = 0u; i < mPerImageData.size(); ++i ) dsLayouts.emplace_back(mGraphicsPipeline->descriptorSetLayouts()[0].get());
-  auto dsInfo = vk::DescriptorSetAllocateInfo()
-    .setDescriptorPool(mDescriptorPoolRenderer.get())
-    .setDescriptorSetCount(dsLayouts.size())
-    .setPSetLayouts(dsLayouts.data());
-
-  auto sets = mDeviceInstance->device().allocateDescriptorSets(dsInfo);
+  // The bindless texture table is allocated by updateTextureTable, sized to the registered textures
+  auto& layouts = mGraphicsPipeline->descriptorSetLayouts();
   for (auto i = 0u; i < mPerImageData.size(); ++i) {
-    mPerImageData[i].uboDescriptor = std::move(sets[i]);
+    mPerImageData[i].uboDescriptor = mDescriptorAllocator->allocate(layouts[0].get()).set;
+    if( !mBindlessTextures ) mPerImageData[i].textureSet = mTextureDescriptors->allocate(layouts[1].get());
   }
 
-  // Create UBOs
+  // Create the frame allocators, holding the UBO, instance data and indirect commands
   for (auto i = 0u; i < mPerImageData.size(); ++i) {
-    std::unique_ptr<SimpleBuffer> ubo(new SimpleBuffer(
+    mPerImageData[i].frameData.reset(new FrameAllocator(
       *mDeviceInstance.get(),
-      sizeof(UBOSetPerFrame),
-      vk::BufferUsageFlagBits::eUniformBuffer));
-    ubo->name() = "Global Frame UBO " + std::to_string(i);
-    mPerImageData[i].ubo = std::move(ubo);
+      FRAME_DATA_SIZE,
+      vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+      "Frame data " + std::to_string(i)));
+
+    // Instance data will grow as needed, start with enough for a reasonable scene
+    // Descriptors must be valid even if unused, so write them all up front
+    ensureInstanceCapacity(i, 1024u);
+    ensureIndirectCapacity(i, 256u);
+    writeFrameDataDescriptors(i);
+    writeMaterialDescriptor(i);
   }
+}
 
-  // Write descriptors to the sets, to bind them to the UBOs
-  for (auto i = 0u; i < mPerImageData.size(); ++i) {
-    auto& ubo = mPerImageData[i].ubo;
-    auto& ds  = mPerImageData[i].uboDescriptor;
-
-    std::vector<vk::DescriptorBufferInfo> uInfos;
-    auto uInfo = vk::DescriptorBufferInfo()
-      .setBuffer(ubo->buffer())
-      .setOffset(0)
-      .setRange(VK_WHOLE_SIZE);
-    uInfos.emplace_back(uInfo);
-
-    auto wInfo = vk::WriteDescriptorSet()
-      .setDstSet(ds)
-      .setDstBinding(0)
-      .setDstArrayElement(0)
-      .setDescriptorCount(static_cast<uint32_t>(uInfos.size()))
-      .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-      .setPImageInfo(nullptr)
-      .setPBufferInfo(uInfos.data())
-      .setPTexelBufferView(nullptr);
-
-    mDeviceInstance->device().updateDescriptorSets(1, &wInfo, 0, nullptr);
-  }
-}
-
-void Renderer::initDescriptorSetsForMeshes() {
-
-  // Create a descriptor pool, to allocate descriptor sets for per-mesh data
-  // Here we've set a resonable limit of 1000, meaning 1000 different material
-  // and texture combinations within a single frame
-  // TODO: At the moment we don't clear down old data, so if the scene changes
-  // over time we'll run out.
-  auto descriptorsPerSet = 1u;
-  auto maxDescriptorSets = 1000u;
-  auto poolSize = vk::DescriptorPoolSize()
-    .setType(vk::DescriptorType::eUniformBuffer)
-    .setDescriptorCount(maxDescriptorSets * descriptorsPerSet);
-
-  auto poolInfo = vk::DescriptorPoolCreateInfo()
-    .setFlags({})
-    .setMaxSets(maxDescriptorSets)
-    .setPoolSizeCount(1)
-    .setPPoolSizes(&poolSize);
-  mDescriptorPoolMeshes = mDeviceInstance->device().createDescriptorPoolUnique(poolInfo);
-}
-
-void Renderer::createDefaultDescriptorSetForMesh() {
-  // Create a default descriptor set/UBO for mesh data
-  // This will serve as the default material is none is available
-  // on the mesh
-  // TODO: Set this up with a nice 'missing texture' texture
-  const vk::DescriptorSetLayout dsLayouts[] = { mGraphicsPipeline->descriptorSetLayouts()[1].get() };
-  auto dsInfo = vk::DescriptorSetAllocateInfo()
-    .setDescriptorPool(mDescriptorPoolMeshes.get())
-    .setDescriptorSetCount(1)
-    .setPSetLayouts(dsLayouts);
-
-  auto sets = mDeviceInstance->device().allocateDescriptorSets(dsInfo);
-  mDescriptorSetMeshDataDefault = std::move(sets.front());
-
-  // Create the default material UBO
-  mUBOMeshDataDefault.reset(new SimpleBuffer(
-    *mDeviceInstance.get(),
-    sizeof(UBOSetPerMaterial),
-    vk::BufferUsageFlagBits::eUniformBuffer));
-  mUBOMeshDataDefault->name() = "Material UBO (Default)";
-
-  UBOSetPerMaterial defaultMat;
-  defaultMat.baseColourFactor = glm::vec4(1.f, 0.f, 1.f, 1.f);
-  std::memcpy(mUBOMeshDataDefault->map(), &defaultMat, sizeof(UBOSetPerMaterial));
-  mUBOMeshDataDefault->flush();
-  mUBOMeshDataDefault->unmap();
-
-  // Write descriptors to the sets, to bind them to the UBOs
-  auto& ubo = mUBOMeshDataDefault;
-
-  std::vector<vk::DescriptorBufferInfo> uInfos;
-  auto uInfo = vk::DescriptorBufferInfo()
-    .setBuffer(ubo->buffer())
-    .setOffset(0)
-    .setRange(VK_WHOLE_SIZE);
-  uInfos.emplace_back(uInfo);
+void Renderer::ensureInstanceCapacity(uint32_t imageIndex, uint32_t count) {
+  auto& imageData = mPerImageData[imageIndex];
+  if( imageData.instanceCapacity >= count ) return;
 
+  // Only called once the image's previous frame has completed, so the
+  // buffer and descriptor set aren't in use
+  auto capacity = std::max(count, imageData.instanceCapacity * 2u);
+  // Only accessed by the gpu, so not in the frame allocator
+  imageData.visibleBuffer.reset(new SimpleBuffer(
+    *mDeviceInstance.get(),
+    capacity * sizeof(uint32_t),
+    vk::BufferUsageFlagBits::eStorageBuffer,
+    vk::MemoryPropertyFlagBits::eDeviceLocal));
+  imageData.visibleBuffer->name() = "Visible instance SSBO " + std::to_string(imageIndex);
+  imageData.instanceCapacity = capacity;
+  // Instance data range has grown
+  imageData.frameDescriptorsDirty = true;
+
+  auto uInfo = vk::DescriptorBufferInfo(imageData.visibleBuffer->buffer(), 0, VK_WHOLE_SIZE);
   auto wInfo = vk::WriteDescriptorSet()
-    .setDstSet(mDescriptorSetMeshDataDefault)
-    .setDstBinding(0)
+    .setDstSet(imageData.uboDescriptor)
+    .setDstBinding(3)
     .setDstArrayElement(0)
-    .setDescriptorCount(static_cast<uint32_t>(uInfos.size()))
-    .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-    .setPImageInfo(nullptr)
-    .setPBufferInfo(uInfos.data())
-    .setPTexelBufferView(nullptr);
+    .setDescriptorCount(1)
+    .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+    .setPBufferInfo(&uInfo);
 
   mDeviceInstance->device().updateDescriptorSets(1, &wInfo, 0, nullptr);
+  imageData.descriptorGeneration++;
+}
+
+void Renderer::ensureIndirectCapacity(uint32_t imageIndex, uint32_t count) {
+  auto& imageData = mPerImageData[imageIndex];
+  if( imageData.indirectCapacity >= count ) return;
+
+  imageData.indirectCapacity = std::max({count, imageData.indirectCapacity * 2u, 256u});
+  imageData.frameDescriptorsDirty = true;
+}
+
+void Renderer::allocateFrameData() {
+  auto imageIndex = mCurrentFrameData.imageIndex;
+  auto& imageData = mPerImageData[imageIndex];
+  auto& frame = mCurrentFrameData;
+
+  // The whole capacity is allocated each frame, rather than what's used, so
+  // offsets (Baked into recorded command buffers) only change when the capacity does
+  auto uboSize = vk::DeviceSize(sizeof(UBOSetPerFrame));
+  auto instanceSize = vk::DeviceSize(imageData.instanceCapacity * sizeof(ShaderInstanceData));
+  auto indirectSize = vk::DeviceSize(imageData.indirectCapacity * sizeof(vk::DrawIndexedIndirectCommand));
+  auto padding = std::max(mUniformAlignment, mStorageAlignment) * 3;
+
+  // Previous frame on this image has completed, everything it allocated is free
+  if( imageData.frameData->reset(uboSize + instanceSize + indirectSize + padding) ) imageData.frameDescriptorsDirty = true;
+  frame.uboRange = imageData.frameData->allocate(uboSize, mUniformAlignment);
+  frame.instanceRange = imageData.frameData->allocate(instanceSize, mStorageAlignment);
+  frame.indirectRange = imageData.frameData->allocate(indirectSize, mStorageAlignment);
+  frame.perFrameOffsets = {
+    static_cast<uint32_t>(frame.uboRange.offset),
+    static_cast<uint32_t>(frame.instanceRange.offset),
+    static_cast<uint32_t>(frame.indirectRange.offset),
+  };
+
+  if( imageData.frameDescriptorsDirty ) writeFrameDataDescriptors(imageIndex);
+  // Materials added this frame may have replaced the buffer
+  if( imageData.materialBufferGeneration != mMaterialBufferGeneration ) writeMaterialDescriptor(imageIndex);
+}
+
+void Renderer::writeFrameDataDescriptors(uint32_t imageIndex) {
+  // Dynamic descriptors have a fixed range, the offset is given at bind time
+  auto& imageData = mPerImageData[imageIndex];
+  auto buffer = imageData.frameData->buffer().buffer();
+  vk::DescriptorBufferInfo uInfos[] = {
+    vk::DescriptorBufferInfo(buffer, 0, sizeof(UBOSetPerFrame)),
+    vk::DescriptorBufferInfo(buffer, 0, imageData.instanceCapacity * sizeof(ShaderInstanceData)),
+    vk::DescriptorBufferInfo(buffer, 0, imageData.indirectCapacity * sizeof(vk::DrawIndexedIndirectCommand)),
+  };
+  vk::DescriptorType types[] = {
+    vk::DescriptorType::eUniformBufferDynamic,
+    vk::DescriptorType::eStorageBufferDynamic,
+    vk::DescriptorType::eStorageBufferDynamic,
+  };
+
+  std::array<vk::WriteDescriptorSet, 3> wInfos;
+  for( auto b = 0u; b < wInfos.size(); ++b ) {
+    wInfos[b] = vk::WriteDescriptorSet()
+      .setDstSet(imageData.uboDescriptor)
+      .setDstBinding(b)
+      .setDstArrayElement(0)
+      .setDescriptorCount(1)
+      .setDescriptorType(types[b])
+      .setPBufferInfo(&uInfos[b]);
+  }
+
+  mDeviceInstance->device().updateDescriptorSets(static_cast<uint32_t>(wInfos.size()), wInfos.data(), 0, nullptr);
+  imageData.frameDescriptorsDirty = false;
+  imageData.descriptorGeneration++;
 }
 
-void Renderer::createDescriptorSetForMesh(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material) {
-  // Ensure a descriptor set and UBO are setup in order to render the mesh/material
-  auto meshData = mMeshRenderData.find(mesh);
-  if (meshData != mMeshRenderData.end()) return;
-
-  // The mesh hasn't been seen before
-  // Create the necesarry descriptor set
-  MeshRenderData d;
-
-  // Setup the UBO, to contain material info
-  UBOSetPerMaterial mat;
-  mat.alphaCutOff = material->alphaCutOff;
-  mat.baseColourFactor = material->baseColourFactor;
-  mat.diffuseFactor = material->diffuseFactor;
-  mat.emissiveFactor = material->emissiveFactor;
-  mat.specularFactor = material->specularFactor;
-  
-  d.uboMaterial.reset(new SimpleBuffer(
+void Renderer::buildDrawGroups() {
+  auto& jobs = mEngine.jobs();
+  auto& snapshot = *mCurrentFrameData.snapshot;
+  auto& instances = snapshot.meshesToRender;
+  auto& groups = mCurrentFrameData.drawGroups;
+  groups.clear();
+
+  // Sort so instances of the same mesh are adjacent
+  // Geometry page first, to minimise buffer binds. Then material, so lookups below are mostly skipped
+  // Only the snapshot's copies are read, the engine may be modifying the meshes
+  // A mesh re-uploaded while the frame was built may have instances with different geometry
+  auto order = [](const MeshRenderInstance& a, const MeshRenderInstance& b) {
+    if( a.geometry.page != b.geometry.page ) return a.geometry.page < b.geometry.page;
+    if( a.mesh != b.mesh ) return a.mesh < b.mesh;
+    if( a.geometry.firstIndex != b.geometry.firstIndex ) return a.geometry.firstIndex < b.geometry.firstIndex;
+    return a.material < b.material;
+  };
+
+  // Each thread's meshes are moved into place and sorted in parallel, as a run of instances
+  auto& threadMeshes = snapshot.threadMeshes;
+  std::vector<size_t> runs = {0u};
+  for( auto& meshes : threadMeshes ) {
+    if( !meshes.empty() ) runs.emplace_back(runs.back() + meshes.size());
+  }
+  instances.resize(runs.back());
+  jobs.parallelFor(static_cast<uint32_t>(threadMeshes.size()), 1u, [&](uint32_t begin, uint32_t end) {
+    for( auto t = begin; t < end; ++t ) {
+      auto& meshes = threadMeshes[t];
+      if( meshes.empty() ) continue;
+      // Offset is the total size of the lists before this one
+      size_t offset = 0u;
+      for( auto p = 0u; p < t; ++p ) offset += threadMeshes[p].size();
+      auto first = instances.begin() + offset;
+      std::move(meshes.begin(), meshes.end(), first);
+      std::sort(first, first + meshes.size(), order);
+    }
+  });
+  for( auto& meshes : threadMeshes ) meshes.clear();
+
+  // Then pairs of runs are merged in parallel, until there's only one
+  while( runs.size() > 2u ) {
+    auto numPairs = static_cast<uint32_t>((runs.size() - 1u) / 2u);
+    jobs.parallelFor(numPairs, 1u, [&](uint32_t begin, uint32_t end) {
+      for( auto p = begin; p < end; ++p ) {
+        std::inplace_merge(instances.begin() + runs[p * 2u], instances.begin() + runs[p * 2u + 1u],
+                           instances.begin() + runs[p * 2u + 2u], order);
+      }
+    });
+    std::vector<size_t> merged;
+    for( auto r = 0u; r < runs.size(); r += 2u ) merged.emplace_back(runs[r]);
+    if( merged.back() != runs.back() ) merged.emplace_back(runs.back());
+    runs = std::move(merged);
+  }
+
+  for( auto i = 0u; i < instances.size(); ++i ) {
+    auto& instance = instances[i];
+    if( groups.empty() || groups.back().mesh != instance.mesh ||
+        groups.back().geometry.page != instance.geometry.page ||
+        groups.back().geometry.firstIndex != instance.geometry.firstIndex ) {
+      DrawGroup group;
+      group.mesh = instance.mesh;
+      group.geometry = instance.geometry;
+      group.firstInstance = i;
+      groups.emplace_back(group);
+    }
+    groups.back().instanceCount++;
+  }
+
+  // Uploads may create pages (Reallocating the pool's page list), so the pool is only read under the upload lock
+  // Groups are sorted by page, only the first group of each needs a lookup
+  {
+    std::lock_guard<std::mutex> lock(mUploadMutex);
+    for( auto g = 0u; g < groups.size(); ++g ) {
+      auto& group = groups[g];
+      if( g > 0 && groups[g - 1].geometry.page == group.geometry.page ) {
+        group.vertexBuffer = groups[g - 1].vertexBuffer;
+        group.indexBuffer = groups[g - 1].indexBuffer;
+        continue;
+      }
+      group.vertexBuffer = mGeometryPool->vertexBuffer(group.geometry.page).buffer();
+      group.indexBuffer = mGeometryPool->indexBuffer(group.geometry.page).buffer();
+    }
+  }
+
+  // Materials are added before the frame's data is allocated, as the material buffer may be replaced
+  auto& materialIndices = mCurrentFrameData.materialIndices;
+  materialIndices.resize(instances.size());
+  std::shared_ptr<Material> lastMaterial;
+  auto lastIndex = 0u;
+  for( auto i = 0u; i < instances.size(); ++i ) {
+    if( i == 0 || instances[i].material != lastMaterial ) {
+      lastMaterial = instances[i].material;
+      lastIndex = materialIndex(lastMaterial, instances[i].materialData);
+    }
+    materialIndices[i] = lastIndex;
+  }
+
+  // Now the sizes are known, allocate the frame's data
+  ensureInstanceCapacity(mCurrentFrameData.imageIndex, static_cast<uint32_t>(instances.size()));
+  ensureIndirectCapacity(mCurrentFrameData.imageIndex, static_cast<uint32_t>(groups.size()));
+  allocateFrameData();
+
+  // Instance data and indirect commands are written in parallel, a range of groups per job
+  // If culling on the gpu the instance counts are filled in by the culling pass
+  auto& frameData = *mPerImageData[mCurrentFrameData.imageIndex].frameData;
+  auto instanceData = static_cast<ShaderInstanceData*>(mCurrentFrameData.instanceRange.data);
+  auto commands = static_cast<vk::DrawIndexedIndirectCommand*>(mCurrentFrameData.indirectRange.data);
+  jobs.parallelFor(static_cast<uint32_t>(groups.size()), 0u, [&](uint32_t begin, uint32_t end) {
+    for( auto g = begin; g < end; ++g ) {
+      auto last = groups[g].firstInstance + groups[g].instanceCount;
+      for( auto i = groups[g].firstInstance; i < last; ++i ) {
+        instanceData[i].modelMatrix = instances[i].modelMatrix;
+        instanceData[i].boundingSphere = instances[i].boundingSphere;
+        instanceData[i].drawIndex = g;
+        instanceData[i].materialIndex = materialIndices[i];
+      }
+
+      // One indirect command per group
+      if( !mIndirectDraws ) continue;
+      auto& geom = groups[g].geometry;
+      commands[g] = vk::DrawIndexedIndirectCommand(
+        geom.indexCount, mGpuCulling ? 0u : groups[g].instanceCount, geom.firstIndex,
+        static_cast<int32_t>(geom.vertexOffset), groups[g].firstInstance);
+    }
+  });
+  frameData.flush(mCurrentFrameData.instanceRange, 0, instances.size() * sizeof(ShaderInstanceData));
+
+  if( !mIndirectDraws || groups.empty() ) return;
+  frameData.flush(mCurrentFrameData.indirectRange, 0, groups.size() * sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+std::vector<vk::CommandBuffer> Renderer::recordSecondaryCommandBuffers(const vk::Framebuffer& frameBuffer) {
+  auto& jobs = mEngine.jobs();
+  auto& imageCommandData = mSecondaryCommandData[mCurrentFrameData.imageIndex];
+  auto& imageData = mPerImageData[mCurrentFrameData.imageIndex];
+
+  // The image's previous frame has completed, and the primary is being
+  // re-recorded, so the buffers it executed can be reset
+  for( auto& chunkData : imageCommandData ) {
+    mDeviceInstance->device().resetCommandPool(chunkData.pool.get(), {});
+  }
+
+  // A couple of chunks per thread, so stealing can balance the load
+  auto numGroups = static_cast<uint32_t>(mCurrentFrameData.drawGroups.size());
+  auto numThreads = mEngine.jobs().workerCount() + 1;
+  auto chunkSize = std::max(MIN_DRAWS_PER_SECONDARY, (numGroups + numThreads * 2 - 1) / (numThreads * 2));
+  auto numChunks = (numGroups + chunkSize - 1) / chunkSize;
+  std::vector<vk::CommandBuffer> result(numChunks);
+
+  auto inheritanceInfo = vk::CommandBufferInheritanceInfo()
+    .setRenderPass(mGraphicsPipeline->renderPass())
+    .setSubpass(0)
+    .setFramebuffer(frameBuffer);
+  auto beginInfo = vk::CommandBufferBeginInfo()
+    .setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue) // Not one-time, may be resubmitted with the primary
+    .setPInheritanceInfo(&inheritanceInfo);
+  auto extent = mWindowIntegration->swapChainExtent();
+  vk::DescriptorSet sets[] = { imageData.uboDescriptor, currentTextureSet() };
+
+  jobs.parallelFor(numChunks, 1, [&](uint32_t begin, uint32_t end) {
+    for( auto c = begin; c < end; ++c ) {
+      // Pools are externally synchronised, each chunk uses its own
+      auto& chunkData = imageCommandData[c];
+      if( !chunkData.buffer ) {
+        auto allocInfo = vk::CommandBufferAllocateInfo()
+          .setCommandPool(chunkData.pool.get())
+          .setCommandBufferCount(1)
+          .setLevel(vk::CommandBufferLevel::eSecondary);
+        auto buffers = mDeviceInstance->device().allocateCommandBuffersUnique(allocInfo);
+        chunkData.buffer = std::move(buffers.front());
+      }
+      auto commandBuffer = chunkData.buffer.get();
+
+      // Secondaries don't inherit state, each binds the pipeline and descriptor sets
+      commandBuffer.begin(beginInfo);
+      commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, mGraphicsPipeline->pipeline());
+      mGraphicsPipeline->setViewport(commandBuffer, extent);
+      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+        mGraphicsPipeline->pipelineLayout(),
+        0, 2,
+        sets,
+        static_cast<uint32_t>(mCurrentFrameData.perFrameOffsets.size()), mCurrentFrameData.perFrameOffsets.data());
+      recordDraws(commandBuffer, c * chunkSize, std::min(numGroups, (c + 1) * chunkSize));
+      commandBuffer.end();
+      result[c] = commandBuffer;
+    }
+  });
+
+  return result;
+}
+
+void Renderer::recordDraws(vk::CommandBuffer& commandBuffer, uint32_t first, uint32_t last) {
+  // Model matrices, material indices and other per-instance data are in the instance SSBO
+  // Groups are sorted by geometry page, any draws within a page
+  // are issued together if using indirect draws
+  // Called from several threads when recording in parallel, must only read renderer state
+  auto& groups = mCurrentFrameData.drawGroups;
+  auto indirectBuffer = mPerImageData[mCurrentFrameData.imageIndex].frameData->buffer().buffer();
+  auto indirectOffset = mCurrentFrameData.indirectRange.offset;
+  auto maxDrawCount = mMaxDrawIndirectCount;
+  const auto stride = static_cast<uint32_t>(sizeof(vk::DrawIndexedIndirectCommand));
+
+  auto boundGeometryPage = std::numeric_limits<uint32_t>::max();
+  auto g = first;
+  while( g < last ) {
+    // Geometry is sub-allocated from the pool, buffers only
+    // need to be bound when moving to a different page
+    auto page = groups[g].geometry.page;
+    if( page != boundGeometryPage ) {
+      vk::Buffer buffers[] = { groups[g].vertexBuffer };
+      vk::DeviceSize offsets[] = { 0 };
+      commandBuffer.bindVertexBuffers(0, 1, buffers, offsets);
+      commandBuffer.bindIndexBuffer(groups[g].indexBuffer, 0, vk::IndexType::eUint32);
+      boundGeometryPage = page;
+    }
+
+    // Find the run of groups sharing these bindings
+    auto runEnd = g + 1;
+    while( runEnd < last &&
+           groups[runEnd].geometry.page == page ) ++runEnd;
+
+    if( mIndirectDraws ) {
+      while( g < runEnd ) {
+        auto count = std::min(runEnd - g, maxDrawCount);
+        commandBuffer.drawIndexedIndirect(indirectBuffer, indirectOffset + g * stride, count, stride);
+        g += count;
+      }
+    } else {
+      // Fallback, record each draw
+      for( ; g < runEnd; ++g ) {
+        auto& geom = groups[g].geometry;
+        commandBuffer.drawIndexed(geom.indexCount, groups[g].instanceCount, geom.firstIndex, static_cast<int32_t>(geom.vertexOffset), groups[g].firstInstance);
+      }
+    }
+  }
+}
+
+void Renderer::recordCulling(vk::CommandBuffer& commandBuffer) {
+  auto& imageData = mPerImageData[mCurrentFrameData.imageIndex];
+  CullPushConstants params;
+  params.instanceCount = static_cast<uint32_t>(mCurrentFrameData.snapshot->meshesToRender.size());
+  if( params.instanceCount == 0 ) return;
+
+  // One invocation per instance, visible instances are appended to their draw
+  commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, mCullPipeline->pipeline());
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+    mCullPipeline->pipelineLayout(),
+    0, 1,
+    &imageData.uboDescriptor,
+    static_cast<uint32_t>(mCurrentFrameData.perFrameOffsets.size()), mCurrentFrameData.perFrameOffsets.data());
+  commandBuffer.pushConstants(mCullPipeline->pipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants), &params);
+  const auto groupSize = 64u; // local_size_x in cull.comp
+  commandBuffer.dispatch((params.instanceCount + groupSize - 1) / groupSize, 1, 1);
+
+  // Draws must wait for the counts/indices to be written
+  auto barrier = vk::MemoryBarrier()
+    .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+    .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead);
+  commandBuffer.pipelineBarrier(
+    vk::PipelineStageFlagBits::eComputeShader,
+    vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader,
+    {}, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Renderer::createMaterialBuffer(uint32_t capacity) {
+  std::unique_ptr<SimpleBuffer> buffer(new SimpleBuffer(
     *mDeviceInstance.get(),
-    sizeof(UBOSetPerMaterial),
-    vk::BufferUsageFlagBits::eUniformBuffer)
-  );
-  d.uboMaterial->name() = "Mesh Material UBO";
-
-  std::memcpy(d.uboMaterial->map(), &mat, sizeof(UBOSetPerMaterial));
-  d.uboMaterial->flush();
-  d.uboMaterial->unmap();
-
-  // TODO: Magic number - This should be encapsulated somehow, or just have a value in case we
-  // change the pipeline layout later (likely)
-  const vk::DescriptorSetLayout dsLayouts[] = { mGraphicsPipeline->descriptorSetLayouts()[1].get() };
-  auto dsInfo = vk::DescriptorSetAllocateInfo()
-    .setDescriptorPool(mDescriptorPoolMeshes.get())
-    .setDescriptorSetCount(1)
-    .setPSetLayouts(dsLayouts);
-
-  try {
-    auto sets = mDeviceInstance->device().allocateDescriptorSets(dsInfo);
-    d.descriptorSet = std::move(sets.front());
-  }
-  catch (vk::OutOfPoolMemoryError& e) {
-    // Explicit check as the pool has a limit
-    // TODO: Could auto-scale and make more pools, or free up
-    // resources and try again?
-    // For now just report the issue and we'll have missing textures
-    // or something (TODO: Like all good engines we should have a default material for missing textures)
-    // TODO TODO: We'll run out really quickly unless the materials are merged - Initially it's
-    // one descriptor per mesh, and a scene could have a lot in it!
-    std::cerr << "Renderer::createDescriptorSet: Ran out of space in descriptor pool" << std::endl;
-    return;
+    capacity * sizeof(ShaderMaterialData),
+    vk::BufferUsageFlagBits::eStorageBuffer));
+  buffer->name() = "Material SSBO";
+  auto data = static_cast<ShaderMaterialData*>(buffer->map());
+
+  if( mMaterialBuffer ) {
+    // Frames in flight still read the old buffer, so it's released rather than destroyed
+    std::memcpy(data, mMaterialData, mMaterialCount * sizeof(ShaderMaterialData));
+    buffer->flush(0, mMaterialCount * sizeof(ShaderMaterialData));
+    releaseResource(std::move(mMaterialBuffer));
   }
-  
-  // Update the descriptor set to map to the buffers
-  std::vector<vk::DescriptorBufferInfo> uInfos;
-  auto uInfo = vk::DescriptorBufferInfo()
-    .setBuffer(d.uboMaterial->buffer())
-    .setOffset(0)
-    .setRange(VK_WHOLE_SIZE);
-  uInfos.emplace_back(uInfo);
 
+  mMaterialBuffer = std::move(buffer);
+  mMaterialData = data;
+  mMaterialCapacity = capacity;
+  mMaterialBufferGeneration++;
+}
+
+uint32_t Renderer::materialIndex(const std::shared_ptr<Material>& material, const ShaderMaterialData& data) {
+  auto it = mMaterialIndices.find(material);
+  if( it != mMaterialIndices.end() ) return it->second;
+
+  // The material hasn't been seen before, add the data converted by renderMesh
+  uint32_t index = 0u;
+  if( !mFreeMaterialIndices.empty() ) {
+    index = mFreeMaterialIndices.back();
+    mFreeMaterialIndices.pop_back();
+  } else {
+    if( mMaterialCount == mMaterialCapacity ) createMaterialBuffer(mMaterialCapacity * 2u);
+    index = mMaterialCount++;
+  }
+
+  // Frames in flight don't reference the entry (It's new, or was freed once they completed)
+  mMaterialData[index] = data;
+  mMaterialBuffer->flush(index * sizeof(ShaderMaterialData), sizeof(ShaderMaterialData));
+
+  mMaterialIndices[material] = index;
+  return index;
+}
+
+void Renderer::writeMaterialDescriptor(uint32_t imageIndex) {
+  // Only called once the image's previous frame has completed
+  auto& imageData = mPerImageData[imageIndex];
+  auto uInfo = vk::DescriptorBufferInfo(mMaterialBuffer->buffer(), 0, VK_WHOLE_SIZE);
   auto wInfo = vk::WriteDescriptorSet()
-    .setDstSet(d.descriptorSet)
-    .setDstBinding(0)
+    .setDstSet(imageData.uboDescriptor)
+    .setDstBinding(4)
     .setDstArrayElement(0)
-    .setDescriptorCount(static_cast<uint32_t>(uInfos.size()))
-    .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-    .setPImageInfo(nullptr)
-    .setPBufferInfo(uInfos.data())
-    .setPTexelBufferView(nullptr);
+    .setDescriptorCount(1)
+    .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+    .setPBufferInfo(&uInfo);
 
   mDeviceInstance->device().updateDescriptorSets(1, &wInfo, 0, nullptr);
-
-  mMeshRenderData[mesh] = std::move(d);
+  imageData.materialBufferGeneration = mMaterialBufferGeneration;
+  imageData.descriptorGeneration++;
 }
 
 void Renderer::renderMesh(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material, glm::mat4x4 modelMat) {
   if( !mesh ) return;
   if( !mesh->validForRender() ) return;
-  if( !material ) material.reset(new Material());
+  if( !material ) material = mDefaultMaterial;
 
   // Note that we need to render the mesh, frameEnd will
   // submit this to the gpu as needed
+  // The snapshot holds copies of everything read while rendering, as the
+  // engine may modify the mesh/material while the render thread is using them
   MeshRenderInstance i;
   i.mesh = mesh;
+  i.material = material;
   i.modelMatrix = modelMat;
-
-  mCurrentFrameData.meshesToRender.emplace_back(i);
-  createDescriptorSetForMesh(mesh, material);
+  i.geometry = mesh->mGeometry;
+  i.boundingSphere = glm::vec4(mesh->mLocalSphere.centre, mesh->mLocalSphere.radius);
+  i.materialData.alphaCutOff = material->alphaCutOff;
+  i.materialData.baseColourFactor = material->baseColourFactor;
+  i.materialData.diffuseFactor = material->diffuseFactor;
+  i.materialData.emissiveFactor = material->emissiveFactor;
+  i.materialData.specularFactor = material->specularFactor;
+
+  // Materials are added to the material buffer by the render thread, when the frame's draws are built
+  mSnapshots[mBuildSnapshot].threadMeshes[mEngine.jobs().threadIndex()].emplace_back(i);
 }
 
 void Renderer::renderLight( const Light& l ) {
-  if( mCurrentFrameData.lightsToRender.size() >= mGraphicsSpecConstants.maxLights ) {
+  std::lock_guard<std::mutex> lock(mLightMutex);
+  auto& lightsToRender = mSnapshots[mBuildSnapshot].lightsToRender;
+  if( lightsToRender.size() >= mGraphicsSpecConstants.maxLights ) {
     // We've hit the limit of the shaders. Probably an insane scene but handle it sensibly
     std::cerr << "WARNING: Renderer::renderLight: Reached the limit of " << mGraphicsSpecConstants.maxLights << " lights. Simplify the scene or increase Renderer::MAX_LIGHTS" << std::endl;
     return;
@@ -565,10 +1046,13 @@ void Renderer::renderLight( const Light& l ) {
     std::cos(l.outerConeAngle),
     static_cast<float>(l.type())
   );
-  mCurrentFrameData.lightsToRender.emplace_back(sl);
+  lightsToRender.emplace_back(sl);
 }
 
 bool Renderer::pollWindowEvents() {
+  // No window, nothing to poll. The engine must be stopped with Engine::quit
+  if( mHeadless ) return true;
+
   // Poll the events, will be handled by the GLFW callbacks
   // and passed to the mEngine's event queue
   glfwPollEvents();
@@ -581,13 +1065,17 @@ bool Renderer::pollWindowEvents() {
 
 void Renderer::frameStart() {
   // Reset any per-frame data
-  mCurrentFrameData.meshesToRender.clear();
-  mCurrentFrameData.lightsToRender.clear();
+  // frameEnd has waited for the render thread to finish with this snapshot
+  auto& snapshot = mSnapshots[mBuildSnapshot];
+  snapshot.threadMeshes.resize(mEngine.jobs().workerCount() + 1);
+  for( auto& meshes : snapshot.threadMeshes ) meshes.clear();
+  snapshot.meshesToRender.clear();
+  snapshot.lightsToRender.clear();
 
   // Update the per-frame uniforms
-  mCurrentFrameData.viewMatrix = mEngine.camera().mViewMatrix;
-  mCurrentFrameData.projectionMatrix = mEngine.camera().mProjectionMatrix;
-  mCurrentFrameData.eyePos = mEngine.camera().mPosition;
+  snapshot.viewMatrix = mEngine.camera().mViewMatrix;
+  snapshot.projectionMatrix = mEngine.camera().mProjectionMatrix;
+  snapshot.eyePos = mEngine.camera().mPosition;
 
   // Engine will now do its thing, we'll get calls to various
   // render methods here, then frameEnd to commit the frame
@@ -597,16 +1085,87 @@ void Renderer::frameStart() {
 //  l.colour = glm::vec4(1.f,1.f,1.f, 1.f);
 //  l.posOrDir = glm::vec4(10.f,10.f,0.f,1.f);
 //  l.typeAndParams.w = static_cast<float>(Light::Type::Point);
-//  mCurrentFrameData.lightsToRender.emplace_back(l);
+//  snapshot.lightsToRender.emplace_back(l);
 }
 
 void Renderer::frameEnd() {
+  // The render thread only has one frame in flight, wait for it to finish the previous one
+  // Nothing else touches the swapchain while it's idle
+  waitForRenderThread();
+  if( mRenderThreadException ) {
+    auto e = mRenderThreadException;
+    mRenderThreadException = nullptr;
+    std::rethrow_exception(e);
+  }
+
   // Handle any explicit resize events from the window system
+  // Resizing calls into glfw, so must happen here rather than on the render thread
   if( mRecreateSwapChainSoon ) {
-    reCreateSwapChainAndGraphicsPipeline();
+    reCreateSwapChain();
     mRecreateSwapChainSoon = false;
   }
 
+  // Anything released from here on is made against the next frame
+  auto built = mBuildSnapshot;
+  mSnapshots[built].serial = mBuildSerial++;
+  mBuildSnapshot = (mBuildSnapshot + 1) % 2;
+  if( !mRenderThread.joinable() ) {
+    renderFrame(mSnapshots[built]);
+    return;
+  }
+
+  mPendingSnapshot = static_cast<int32_t>(built);
+  mPendingSnapshot.notify_all();
+}
+
+void Renderer::startRenderThread() {
+  if( mRenderThread.joinable() ) return;
+  mPendingSnapshot = NO_SNAPSHOT;
+  mRenderThread = std::thread(&Renderer::renderThreadLoop, this);
+}
+
+void Renderer::stopRenderThread() {
+  if( !mRenderThread.joinable() ) return;
+  waitForRenderThread();
+  mPendingSnapshot = QUIT_RENDER_THREAD;
+  mPendingSnapshot.notify_all();
+  mRenderThread.join();
+  mPendingSnapshot = NO_SNAPSHOT;
+  // Any error in the final frame has already been reported by renderFrame
+  mRenderThreadException = nullptr;
+}
+
+void Renderer::waitForRenderThread() {
+  auto pending = mPendingSnapshot.load();
+  while( pending != NO_SNAPSHOT ) {
+    mPendingSnapshot.wait(pending);
+    pending = mPendingSnapshot.load();
+  }
+}
+
+void Renderer::renderThreadLoop() {
+  while( true ) {
+    mPendingSnapshot.wait(NO_SNAPSHOT);
+    auto pending = mPendingSnapshot.load();
+    if( pending == QUIT_RENDER_THREAD ) return;
+
+    try {
+      renderFrame(mSnapshots[pending]);
+    } catch (...) {
+      mRenderThreadException = std::current_exception();
+    }
+
+    // Hand the snapshot back, the engine may now build into it
+    mPendingSnapshot = NO_SNAPSHOT;
+    mPendingSnapshot.notify_all();
+  }
+}
+
+void Renderer::renderFrame(FrameSnapshot& snapshot) {
+  mCurrentFrameData.snapshot = &snapshot;
+  for( auto& material : snapshot.materialsToRelease ) destroyMaterialData(material);
+  snapshot.materialsToRelease.clear();
+
   // Important that we catch any vulkan errors here
   // Renderer assumes the default of exceptions enabled for vulkan.hpp
   // and probably won't even build with them disabled
@@ -617,23 +1176,34 @@ void Renderer::frameEnd() {
     // Wait until any previous runs of this frame have finished
     mDeviceInstance->device().waitForFences(1, &mPerFrameData[mCurrentFrameData.frameIndex].renderFinishedFence.get(), true, std::numeric_limits<uint64_t>::max());
 
+    // Frames complete in order, so anything released up to the waited frame is no longer in use
+    auto& frameData = mPerFrameData[mCurrentFrameData.frameIndex];
+    if( frameData.submitted ) mDeletionQueue.collect(frameData.submittedSerial);
+
     // TODO: We should perform buffer updates and such here
     // before waiting on the swapchain image's fence/performing blocking calls below
 
-    // Acquire an image from the swap chain
-    // Important: The image index will probably not match the frame index - If the gpu can empty
-    // the swap chain we'll probably just get the 1st/2nd ones, with any others being rarely used.
-    auto img = mDeviceInstance->device().acquireNextImageKHR(
-      mWindowIntegration->swapChain(), // Get an image from this
-      std::numeric_limits<uint64_t>::max(), // Don't timeout, block until an image is available (TODO: Should skip the frame and let the engine continue updating?)
-      mPerFrameData[mCurrentFrameData.frameIndex].imageAvailableSem.get(), // semaphore to signal once any existing presentation tasks are done with this image, and that it's available to be presented to
-      vk::Fence()); // Dummy fence, we don't care here
-
-    if( img.result == vk::Result::eSuboptimalKHR ) {
-      // This isn't an error in that we can continue rendering, but we should recreate the swapchain soon
-      mRecreateSwapChainSoon = true;
+    if( mHeadless ) {
+      // No swapchain, just cycle through the offscreen images
+      mCurrentFrameData.imageIndex = mCurrentFrameData.headlessImageIndex;
+      mCurrentFrameData.headlessImageIndex++;
+      if( mCurrentFrameData.headlessImageIndex == mWindowIntegration->swapChainSize() ) mCurrentFrameData.headlessImageIndex = 0;
+    } else {
+      // Acquire an image from the swap chain
+      // Important: The image index will probably not match the frame index - If the gpu can empty
+      // the swap chain we'll probably just get the 1st/2nd ones, with any others being rarely used.
+      auto img = mDeviceInstance->device().acquireNextImageKHR(
+        mWindowIntegration->swapChain(), // Get an image from this
+        std::numeric_limits<uint64_t>::max(), // Don't timeout, block until an image is available (TODO: Should skip the frame and let the engine continue updating?)
+        mPerFrameData[mCurrentFrameData.frameIndex].imageAvailableSem.get(), // semaphore to signal once any existing presentation tasks are done with this image, and that it's available to be presented to
+        vk::Fence()); // Dummy fence, we don't care here
+
+      if( img.result == vk::Result::eSuboptimalKHR ) {
+        // This isn't an error in that we can continue rendering, but we should recreate the swapchain soon
+        mRecreateSwapChainSoon = true;
+      }
+      mCurrentFrameData.imageIndex = img.value;
     }
-    mCurrentFrameData.imageIndex = img.value;
 
     // If we already have a fence for the image we need to wait - The last frame using this image is active
     if( mPerImageData[mCurrentFrameData.imageIndex].fence ) {
@@ -641,14 +1211,37 @@ void Renderer::frameEnd() {
     }
     mPerImageData[mCurrentFrameData.imageIndex].fence = mPerFrameData[mCurrentFrameData.frameIndex].renderFinishedFence.get();
 
-    // Rebuild the command buffer every frame
-    // This isn't the most efficient but we're at least re-using the command buffer
-    // In a most complex application we would have multiple command buffers and only rebuild
-    // the section that needs changing..I think
+    // The image's previous frame is complete, collect its timings before the queries are reused
+    readTimestampQueries(mCurrentFrameData.imageIndex);
+
+    // Textures registered since the image was last rendered
+    updateTextureTable();
+
+    // Group the frame's instances into draws, now that the image's buffers are free
+    buildDrawGroups();
+
+    // Camera/lights are read from the UBO, so are updated regardless of the commands
+    updatePerFrameUBO();
+
+    // Only rebuild the command buffer if the draws have changed since the image was
+    // last recorded. For a static scene the previous commands can be resubmitted,
+    // as the per-frame data they read has been updated above
     auto& commandBuffer = mCommandBuffers[mCurrentFrameData.imageIndex].get();
-    buildCommandBuffer(
-      commandBuffer,
-      mFrameBuffer->frameBuffers()[mCurrentFrameData.imageIndex].get());
+    auto& frameBuffer = mFrameBuffer->frameBuffers()[mCurrentFrameData.imageIndex].get();
+    auto& imageData = mPerImageData[mCurrentFrameData.imageIndex];
+    auto& recordState = mCurrentFrameData.recordState;
+    captureRecordedState(recordState, frameBuffer);
+    if( mResourcesReleased.exchange(false) ) {
+      // A released resource may be referenced by the recorded commands, and its handle reused
+      for( auto& d : mPerImageData ) d.recorded = RecordedState();
+    }
+    if( recordState == imageData.recorded ) {
+      mFrameStats.framesReused++;
+    } else {
+      buildCommandBuffer(commandBuffer, frameBuffer);
+      // Swapped so the vectors' storage is reused next frame
+      std::swap(imageData.recorded, recordState);
+    }
 
     // Setup synchronisation for the command buffer submission
     // - Wait until the presentation image is available before execution
@@ -658,14 +1251,15 @@ void Renderer::frameEnd() {
     vk::Semaphore waitSemaphores[]{ mPerFrameData[mCurrentFrameData.frameIndex].imageAvailableSem.get() };
     vk::PipelineStageFlags waitStages[]{ vk::PipelineStageFlagBits::eColorAttachmentOutput };
     auto& renderFinishedSemaphore = mPerFrameData[mCurrentFrameData.frameIndex].renderFinishedSem.get();
+    // If headless there's no acquire/present to synchronise with, the fence is enough
     auto submitInfo = vk::SubmitInfo()
-      .setWaitSemaphoreCount(1)
-      .setPWaitSemaphores(waitSemaphores)
-      .setPWaitDstStageMask(waitStages)
+      .setWaitSemaphoreCount(mHeadless ? 0 : 1)
+      .setPWaitSemaphores(mHeadless ? nullptr : waitSemaphores)
+      .setPWaitDstStageMask(mHeadless ? nullptr : waitStages)
       .setCommandBufferCount(1)
       .setPCommandBuffers(&commandBuffer)
-      .setSignalSemaphoreCount(1)
-      .setPSignalSemaphores(&renderFinishedSemaphore)
+      .setSignalSemaphoreCount(mHeadless ? 0 : 1)
+      .setPSignalSemaphores(mHeadless ? nullptr : &renderFinishedSemaphore)
       ;
 
     // Present the results of a frame to the swap chain
@@ -686,15 +1280,24 @@ void Renderer::frameEnd() {
             throw std::runtime_error("Renderer: Failed to reset frame fence");
     }
 
+    // Uploads queued during the frame must reach the queue before it's rendered
+    std::unique_lock<std::mutex> uploadLock(mUploadMutex);
+    mUploadBatcher->submit();
+
     // submit, signal the frame fence at the end
     auto submitResult = mQueue->queue.submit(1, &submitInfo, mPerFrameData[mCurrentFrameData.frameIndex].renderFinishedFence.get());
     if( submitResult != vk::Result::eSuccess ) {
         throw std::runtime_error("Renderer: Queue submission failed");
       }
+    mPerImageData[mCurrentFrameData.imageIndex].timestampsWritten = true;
+    mFrameStats.framesSubmitted++;
+    frameData.submittedSerial = snapshot.serial;
+    frameData.submitted = true;
 
     // TODO: Currently using a single queue for both graphics and present
     // Some systems may not be able to support this
-    mQueue->queue.presentKHR(presentInfo);
+    if( !mHeadless ) mQueue->queue.presentKHR(presentInfo);
+    uploadLock.unlock();
 
     // Advance to next frame index, loop at max
     mCurrentFrameData.frameIndex++;
@@ -702,14 +1305,15 @@ void Renderer::frameEnd() {
   }
   catch ( vk::OutOfDateKHRError& e ) {
     // Either acquireNextImageKHR or presentKHR returned OutOfDate, meaning a window resize/similar
-    reCreateSwapChainAndGraphicsPipeline();
+    // The frame is dropped, the swapchain is recreated before the next one
+    mRecreateSwapChainSoon = true;
   }
   catch (vk::Error& e) {
-    std::cerr << "Renderer::frameEnd: vk::Error: " << e.what() << std::endl;
+    std::cerr << "Renderer::renderFrame: vk::Error: " << e.what() << std::endl;
     throw;
   }
   catch (...) {
-    std::cerr << "Renderer::frameEnd: Unknown Exception:" << std::endl;
+    std::cerr << "Renderer::renderFrame: Unknown Exception:" << std::endl;
     throw;
   }
 }
@@ -728,26 +1332,50 @@ void Renderer::cleanup() {
     // Already cleaned up, or otherwise invalid
     return;
   }
+  stopRenderThread();
   mDeviceInstance->waitAllDevicesIdle();
-
-  mUBOMeshDataDefault.reset();
-  mMeshRenderData.clear();
+  mDeviceInstance->savePipelineCache();
+  // Device is idle, everything pending can go
+  mDeletionQueue.clear();
+
+  mMaterialIndices.clear();
+  mFreeMaterialIndices.clear();
+  mMaterialData = nullptr;
+  mMaterialBuffer.reset();
+  mMaterialCount = 0u;
+  mMaterialCapacity = 0u;
+  mDefaultMaterial.reset();
+  mTextures.clear();
+  mFreeTextureIndices.clear();
+  mDirtyTextures.clear();
+  mTextureSet = {};
+  mTextureSetCapacity = 0u;
+  mDefaultTexture.reset();
+  mDefaultSampler.reset();
   mPerImageData.clear();
   mPerFrameData.clear();
+  mTimestampQueryPool.reset();
 
+  mSecondaryCommandData.clear();
   mCommandBuffers.clear();
   mCommandPool.reset();
+  mGeometryPool.reset();
+  mUploadBatcher.reset();
 
-  mDescriptorPoolMeshes.reset();
-  mDescriptorPoolRenderer.reset();
+  mTextureDescriptors.reset();
+  mDescriptorAllocator.reset();
 
+  mCullPipeline.reset();
   mGraphicsPipeline.reset();
   mFrameBuffer.reset();
   mWindowIntegration.reset();
   mDeviceInstance.reset();
 
-  glfwDestroyWindow(mWindow);
-  glfwTerminate();
+  if( mWindow ) {
+    glfwDestroyWindow(mWindow);
+    glfwTerminate();
+    mWindow = nullptr;
+  }
 }
 
 
@@ -755,7 +1383,8 @@ std::unique_ptr<SimpleBuffer> Renderer::createSimpleVertexBuffer(std::vector<Ver
   std::unique_ptr<SimpleBuffer> result(new SimpleBuffer(
     *mDeviceInstance.get(),
     verts.size() * sizeof(decltype(verts)::value_type),
-    vk::BufferUsageFlagBits::eVertexBuffer));
+    vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    geometryMemoryFlags()));
   result->name() = "Renderer::createSimpleVertexBuffer";
   return result;
 }
@@ -764,7 +1393,246 @@ std::unique_ptr<SimpleBuffer> Renderer::createSimpleIndexBuffer(std::vector<uint
   std::unique_ptr<SimpleBuffer> result(new SimpleBuffer(
     *mDeviceInstance.get(),
     indices.size() * sizeof(decltype(indices)::value_type),
-    vk::BufferUsageFlagBits::eIndexBuffer));
+    vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    geometryMemoryFlags()));
   result->name() = "Renderer::createSimpleIndexBuffer";
   return result;
 }
+
+vk::MemoryPropertyFlags Renderer::geometryMemoryFlags() {
+  // Geometry lives in device local memory, only written directly if the host can see it anyway
+  if( mDeviceInstance->isUnifiedMemory() ) return vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible;
+  return vk::MemoryPropertyFlagBits::eDeviceLocal;
+}
+
+void Renderer::uploadBuffer(SimpleBuffer& buffer, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset) {
+  std::lock_guard<std::mutex> lock(mUploadMutex);
+  writeBuffer(buffer, data, size, dstOffset);
+}
+
+void Renderer::writeBuffer(SimpleBuffer& buffer, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset) {
+  if( buffer.memoryFlags() & vk::MemoryPropertyFlagBits::eHostVisible ) {
+    std::memcpy(static_cast<uint8_t*>(buffer.map()) + dstOffset, data, size);
+    buffer.flush(dstOffset, size);
+    buffer.unmap();
+    return;
+  }
+
+  mUploadBatcher->enqueueBuffer(buffer, data, size, dstOffset);
+}
+
+GeometryPool::Handle Renderer::uploadGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+  std::lock_guard<std::mutex> lock(mUploadMutex);
+  auto handle = mGeometryPool->allocate(static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size()));
+  writeBuffer(mGeometryPool->vertexBuffer(handle.page),
+              vertices.data(), vertices.size() * sizeof(Vertex),
+              handle.vertexOffset * mGeometryPool->vertexSize());
+  writeBuffer(mGeometryPool->indexBuffer(handle.page),
+              indices.data(), indices.size() * GeometryPool::indexSize,
+              handle.firstIndex * GeometryPool::indexSize);
+  return handle;
+}
+
+void Renderer::freeGeometry(GeometryPool::Handle& handle) {
+  if( !mGeometryPool || !handle.valid() ) return;
+  // Frames in flight may still be drawing from the range, it can't be reused until they're done
+  auto freed = handle;
+  handle = GeometryPool::Handle();
+  deferRelease([this, freed]() mutable {
+    std::lock_guard<std::mutex> lock(mUploadMutex);
+    if( mGeometryPool ) mGeometryPool->free(freed);
+  });
+}
+
+void Renderer::deferRelease(DeletionQueue::Function fn) {
+  mDeletionQueue.defer(mBuildSerial, std::move(fn));
+  mResourcesReleased = true;
+}
+
+void Renderer::releaseMaterial(std::shared_ptr<Material> material) {
+  mSnapshots[mBuildSnapshot].materialsToRelease.emplace_back(std::move(material));
+}
+
+void Renderer::destroyMaterialData(std::shared_ptr<Material> material) {
+  auto it = mMaterialIndices.find(material);
+  if( it == mMaterialIndices.end() ) return;
+
+  // Frames in flight may still read the entry, it can't be reused until they're done
+  auto index = it->second;
+  mMaterialIndices.erase(it);
+  deferRelease([this, index]() {
+    mFreeMaterialIndices.emplace_back(index);
+  });
+}
+
+void Renderer::initTextureTable() {
+  // Combined image samplers count against both the sampler and sampled image limits
+  if( mDeviceInstance->descriptorIndexing() ) {
+    auto props = mDeviceInstance->physicalDevice().getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    auto& indexing = props.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    mBindlessTextures = true;
+    mMaxTextures = std::min({
+      MAX_TEXTURES,
+      indexing.maxPerStageDescriptorUpdateAfterBindSamplers,
+      indexing.maxPerStageDescriptorUpdateAfterBindSampledImages,
+      indexing.maxDescriptorSetUpdateAfterBindSamplers,
+      indexing.maxDescriptorSetUpdateAfterBindSampledImages,
+    });
+  } else {
+    auto& limits = mDeviceInstance->physicalDevice().getProperties().limits;
+    mBindlessTextures = false;
+    mMaxTextures = std::min({
+      MAX_TEXTURES_FALLBACK,
+      limits.maxPerStageDescriptorSamplers,
+      limits.maxPerStageDescriptorSampledImages,
+      limits.maxDescriptorSetSamplers,
+      limits.maxDescriptorSetSampledImages,
+    });
+  }
+  mMaxTextures = std::max(mMaxTextures, 1u);
+  mGraphicsSpecConstants.maxTextures = mMaxTextures;
+}
+
+void Renderer::createDefaultTexture() {
+  mDefaultTexture.reset(new SimpleImage(
+    *mDeviceInstance.get(),
+    vk::ImageType::e2D,
+    vk::ImageViewType::e2D,
+    vk::Format::eR8G8B8A8Unorm,
+    vk::Extent3D(1, 1, 1),
+    1, 1,
+    vk::SampleCountFlagBits::e1,
+    vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+    vk::MemoryPropertyFlagBits::eDeviceLocal,
+    vk::ImageAspectFlagBits::eColor));
+  mDefaultTexture->name() = "Default texture";
+
+  const uint32_t white = 0xffffffff;
+  {
+    std::lock_guard<std::mutex> lock(mUploadMutex);
+    mUploadBatcher->enqueueImage(mDefaultTexture->image(), vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+                                 vk::Extent3D(1, 1, 1), &white, sizeof(white), vk::ImageLayout::eShaderReadOnlyOptimal);
+  }
+
+  auto samplerInfo = vk::SamplerCreateInfo()
+    .setMagFilter(vk::Filter::eLinear)
+    .setMinFilter(vk::Filter::eLinear)
+    .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+    .setAddressModeU(vk::SamplerAddressMode::eRepeat)
+    .setAddressModeV(vk::SamplerAddressMode::eRepeat)
+    .setAddressModeW(vk::SamplerAddressMode::eRepeat)
+    .setMaxLod(VK_LOD_CLAMP_NONE);
+  mDefaultSampler = mDeviceInstance->device().createSamplerUnique(samplerInfo);
+
+  if( registerTexture(mDefaultTexture->view(), mDefaultSampler.get()) != 0u ) {
+    throw std::runtime_error("Renderer::createDefaultTexture: Default texture must be the first in the table");
+  }
+}
+
+uint32_t Renderer::registerTexture(vk::ImageView view, vk::Sampler sampler) {
+  std::lock_guard<std::mutex> lock(mTextureMutex);
+  uint32_t index = 0u;
+  if( !mFreeTextureIndices.empty() ) {
+    index = mFreeTextureIndices.back();
+    mFreeTextureIndices.pop_back();
+  } else {
+    if( mTextures.size() >= mMaxTextures ) {
+      throw std::runtime_error("Renderer::registerTexture: Texture table is full (" + std::to_string(mMaxTextures) + " textures)");
+    }
+    index = static_cast<uint32_t>(mTextures.size());
+    mTextures.emplace_back();
+  }
+
+  // Written to the sets by the render thread, before the next frame is recorded
+  mTextures[index] = {view, sampler};
+  if( mBindlessTextures ) mDirtyTextures.emplace_back(index);
+  mTextureGeneration++;
+  return index;
+}
+
+void Renderer::releaseTexture(uint32_t index) {
+  // The default texture is owned by the renderer
+  if( index == 0u ) return;
+  {
+    std::lock_guard<std::mutex> lock(mTextureMutex);
+    if( index >= mTextures.size() || !mTextures[index].view ) return;
+    mTextures[index] = {};
+    mTextureGeneration++;
+  }
+
+  // Frames in flight may still sample the entry, it can't be reused until they're done
+  deferRelease([this, index]() {
+    std::lock_guard<std::mutex> lock(mTextureMutex);
+    mFreeTextureIndices.emplace_back(index);
+  });
+}
+
+void Renderer::updateTextureTable() {
+  std::lock_guard<std::mutex> lock(mTextureMutex);
+  auto& imageData = mPerImageData[mCurrentFrameData.imageIndex];
+  auto& defaultEntry = mTextures.front();
+
+  vk::DescriptorSet set;
+  std::vector<uint32_t> indices;
+  if( mBindlessTextures ) {
+    if( mTextures.size() > mTextureSetCapacity ) {
+      // Frames in flight use the current set, so it's replaced with a larger one rather than reallocated
+      auto capacity = std::min(mMaxTextures, std::max({static_cast<uint32_t>(mTextures.size()), mTextureSetCapacity * 2u, 256u}));
+      auto oldSet = mTextureSet;
+      mTextureSet = mTextureDescriptors->allocate(mGraphicsPipeline->descriptorSetLayouts()[1].get(), capacity);
+      mTextureSetCapacity = capacity;
+      if( oldSet.set ) {
+        deferRelease([this, oldSet]() mutable {
+          if( mTextureDescriptors ) mTextureDescriptors->free(oldSet);
+        });
+      }
+      // Every entry needs writing to the new set
+      mDirtyTextures.clear();
+      for( auto i = 0u; i < mTextures.size(); ++i ) mDirtyTextures.emplace_back(i);
+    }
+    // New entries aren't used by frames in flight, so may be written while they're pending
+    // Released entries are left as they are, partially bound sets only need used entries to be valid
+    set = mTextureSet.set;
+    std::swap(indices, mDirtyTextures);
+  } else {
+    if( imageData.textureGeneration == mTextureGeneration ) return;
+    // Not partially bound, every entry must be valid. The image's previous frame has
+    // completed, but its command buffer must be re-recorded as the set has been updated
+    set = imageData.textureSet.set;
+    indices.resize(mMaxTextures);
+    for( auto i = 0u; i < mMaxTextures; ++i ) indices[i] = i;
+    imageData.textureGeneration = mTextureGeneration;
+    imageData.descriptorGeneration++;
+  }
+  if( indices.empty() ) return;
+
+  std::vector<vk::DescriptorImageInfo> imageInfos;
+  std::vector<vk::WriteDescriptorSet> writes;
+  imageInfos.reserve(indices.size());
+  writes.reserve(indices.size());
+  for( auto index : indices ) {
+    auto entry = index < mTextures.size() ? mTextures[index] : TextureEntry();
+    if( !entry.view ) {
+      if( mBindlessTextures ) continue;
+      entry = defaultEntry;
+    }
+    imageInfos.emplace_back(entry.sampler, entry.view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    writes.emplace_back(vk::WriteDescriptorSet()
+      .setDstSet(set)
+      .setDstBinding(0)
+      .setDstArrayElement(index)
+      .setDescriptorCount(1)
+      .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+      .setPImageInfo(&imageInfos.back()));
+  }
+  mDeviceInstance->device().updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+vk::DescriptorSet Renderer::currentTextureSet() const {
+  return mBindlessTextures ? mTextureSet.set : mPerImageData[mCurrentFrameData.imageIndex].textureSet.set;
+}
+
+void Renderer::flushUploads() {
+  std::lock_guard<std::mutex> lock(mUploadMutex);
+  mUploadBatcher->submit();
+}
@@ -12,7 +12,14 @@
 #include "util/deviceinstance.h"
 #include "util/framebuffer.h"
 #include "util/simplebuffer.h"
+#include "util/uploadbatcher.h"
+#include "util/deletionqueue.h"
+#include "util/frameallocator.h"
+#include "util/descriptorallocator.h"
+#include "util/simpleimage.h"
+#include "geometrypool.h"
 #include "util/pipelines/graphicspipeline.h"
+#include "util/pipelines/computepipeline.h"
 
 #include "vertex.h"
 #include "mesh.h"
@@ -29,6 +36,7 @@
 // https://github.com/KhronosGroup/Vulkan-Hpp
 #include <vulkan/vulkan.hpp>
 
+#include <array>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -36,6 +44,9 @@
 #include <map>
 #include <string>
 #include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 class FrameBuffer;
 class SimpleBuffer;
@@ -53,8 +64,14 @@ private:
   // Defaults for these should be more than ridiculous,
   // so shouldn't need to touch these.
   static const uint32_t MAX_LIGHTS = 100;
+  // Upper bound of the texture table, further limited by the device
+  static constexpr uint32_t MAX_TEXTURES = 65536;
+  // Without descriptor indexing the table is a fixed size, and fully written for each image
+  static constexpr uint32_t MAX_TEXTURES_FALLBACK = 1024;
   struct GraphicsSpecConstants {
     uint32_t maxLights = MAX_LIGHTS;
+    VkBool32 gpuCulling = VK_FALSE;
+    uint32_t maxTextures = 1u; // Size of the texture table's array
   };
   GraphicsSpecConstants mGraphicsSpecConstants;
   // As defined by glTF Punctual lights extension
@@ -76,42 +93,118 @@ private:
     ShaderLightData lights[MAX_LIGHTS];
   };
 
-  /// Per-Material/Mesh uniforms, Binding = 1
-  struct UBOSetPerMaterial {
+  /// Per-material data, storage buffer in the per-frame set, binding = 4
+  /// One entry for each unique material, std430 layout so 16-byte aligned
+  struct ShaderMaterialData {
     glm::vec4 baseColourFactor;
     glm::vec4 emissiveFactor;
     glm::vec4 diffuseFactor;
     glm::vec3 specularFactor;
-    float pad;
     float alphaCutOff;
-    // TODO: And magically we're 16-byte aligned
-    // When adding more data be careful here
   };
 
-  /// Push constants for the most frequently changing data
-  /// @note Size must be multiple of 4 here, renderer doesn't check size
-  /// @note Limit of 128 bytes - Minimum capacity required by spec
-  struct PushConstantSet {
+  /// Per-instance data, storage buffer in the per-frame set, binding = 1
+  struct ShaderInstanceData {
     glm::mat4x4 modelMatrix;
+    glm::vec4 boundingSphere; // Model space, xyz == centre, w == radius
+    uint32_t drawIndex; // Index of the instance's DrawGroup/indirect command
+    uint32_t materialIndex; // Index of the instance's ShaderMaterialData
+    uint32_t pad2;
+    uint32_t pad3;
+  };
+
+  /// Push constants for the culling pass
+  struct CullPushConstants {
+    uint32_t instanceCount;
   };
 
 // The renderer class itself
 public:
-  Renderer( Engine& engine );
+  /**
+   * @param headless If true no window will be created, rendering
+   *                 is performed to a ring of offscreen images instead
+   *                 of a swapchain. Otherwise behaviour is identical.
+   */
+  Renderer( Engine& engine, bool headless = false );
   ~Renderer();
 
+  /// Timing information for the renderer
+  struct FrameStats {
+    uint64_t framesSubmitted = 0u;
+    /// GPU time of the most recently completed frame (ms), 0 if not available
+    double lastGpuFrameTime = 0.0;
+    /// Total GPU time of all completed frames (ms)
+    double totalGpuFrameTime = 0.0;
+    uint64_t gpuFramesTimed = 0u;
+    /// Frames which resubmitted the image's previous command buffer, rather than recording a new one
+    uint64_t framesReused = 0u;
+  };
+
   /**
    * Create buffers/upload to GPU
    */
   std::unique_ptr<SimpleBuffer> createSimpleVertexBuffer(std::vector<Vertex> verts);
   std::unique_ptr<SimpleBuffer> createSimpleIndexBuffer(std::vector<uint32_t> indices);
 
+  /**
+   * Write data into a buffer created by the renderer
+   * If the buffer isn't host visible the write is queued in the upload batcher,
+   * pending uploads are submitted by flushUploads or at the end of the frame
+   * Uploads may be made while the render thread is running
+   */
+  void uploadBuffer(SimpleBuffer& buffer, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset = 0);
+
+  /**
+   * Allocate space for a mesh in the geometry pool and upload its data
+   * @return Handle to the geometry, to be released with freeGeometry
+   */
+  GeometryPool::Handle uploadGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+  void freeGeometry(GeometryPool::Handle& handle);
+  /// Submit any pending uploads
+  void flushUploads();
+
+  /**
+   * Release a resource which may still be in use by frames in flight (Buffers, images, pipelines, etc)
+   * It's destroyed once the frame being built, and all before it, have completed
+   * May be called from any thread
+   */
+  template<typename T>
+  void releaseResource(T resource) {
+    mDeletionQueue.release(mBuildSerial, std::move(resource));
+    mResourcesReleased = true;
+  }
+  /// Call fn once the frame being built, and all before it, have completed
+  void deferRelease(DeletionQueue::Function fn);
+
+  /**
+   * Release a material's entry in the material buffer
+   * If the material is rendered again it'll be re-added
+   * Applied at the end of the frame being built, as the render thread may be using them
+   */
+  void releaseMaterial(std::shared_ptr<Material> material);
+
+  /**
+   * Add a texture to the texture table, shaders sample it as textures[index]
+   * The image must be in eShaderReadOnlyOptimal. Index 0 is a white texture, for materials without one
+   * The caller keeps ownership of the image, view and sampler. Frames in flight (And without
+   * bindless, the images' texture sets) still reference them after releaseTexture, so once released
+   * they must be destroyed through releaseResource/deferRelease, not immediately
+   * Throws if the table is full. May be called from any thread
+   */
+  uint32_t registerTexture(vk::ImageView view, vk::Sampler sampler);
+  /**
+   * Remove a texture from the table, its index is reused once frames in flight have completed
+   * Call before passing the texture's image, view and sampler to releaseResource
+   */
+  void releaseTexture(uint32_t index);
+
   /**
    * Called by any mesh nodes in the node graph during the render traversal
    * Logs the mesh for submission as part of the frame
+   * May be called from any of the engine's job system threads
    */
   void renderMesh( std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material, glm::mat4x4 modelMat );
-  /// Called during node graph traversal
+  /// Called during node graph traversal, from any of the job system threads
   /// Logs a light for the frame
   void renderLight( const Light& l );
 
@@ -126,15 +219,39 @@ public:
 
   /**
    * Render a frame
+   * Meshes/lights logged between frameStart and frameEnd are collected into a
+   * snapshot of the frame. frameEnd renders the snapshot, or if the render thread
+   * is running hands it over and returns, so the next frame can be built meanwhile
    */
   void frameStart();
   void frameEnd();
+
+  /**
+   * Record and submit frames on a separate thread
+   * The calling thread only waits for the render thread if it's still busy with the
+   * previous frame, rather than on the gpu/swapchain. Call after initVK
+   */
+  void startRenderThread();
+  /// Finish the frame being rendered and stop the render thread
+  void stopRenderThread();
+
   void waitIdle();
   void cleanup();
 
   int windowWidth() const;
   int windowHeight() const;
 
+  bool headless() const { return mHeadless; }
+  /**
+   * Directory the pipeline cache is loaded from, and saved to in cleanup
+   * Must be set before initVK. If empty (The default) there's no on-disk cache
+   */
+  void pipelineCacheDirectory(const std::string& directory) { mPipelineCacheDirectory = directory; }
+  const std::string& pipelineCacheDirectory() const { return mPipelineCacheDirectory; }
+  /// The renderer's device, valid between initVK and cleanup
+  DeviceInstance& deviceInstance() { return *mDeviceInstance.get(); }
+  const FrameStats& frameStats() const { return mFrameStats; }
+
 private:
   void onGLFWKeyEvent(int key, int scancode, int action, int mods);
   void onGLFWFramebufferSize(int width, int height);
@@ -142,20 +259,86 @@ private:
   // Create the swap chain, graphics pipeline, framebuffers, etc
   // Before calling make sure mQueue == The graphics/presentation queue
   void createSwapChainAndGraphicsPipeline();
-  void reCreateSwapChainAndGraphicsPipeline();
+  void createGraphicsPipeline();
+  /// Recreate the swapchain and framebuffers after a resize, the pipeline is only rebuilt if required
+  void reCreateSwapChain();
+  /// Create a primary command buffer for each swapchain image
+  void createCommandBuffers();
+  /// Recreate everything sized by the number of swapchain images, after the count has changed
+  void rebuildPerImageData();
+
+  /// Register the per-frame descriptor set (set 0) on a pipeline
+  /// Shared by the graphics and culling pipelines, so the layouts must be identical
+  void addPerFrameDescriptorSetLayout(Pipeline& pipeline);
+  /// Register the texture table (set 1) on a pipeline
+  void addTextureDescriptorSetLayout(Pipeline& pipeline);
+  /// Create the compute pipeline for gpu culling
+  void createCullPipeline();
+  /**
+   * Create a shader module for one of the renderer's shaders
+   * Embedded in the binary if built with EMBED_SHADERS, otherwise loaded from RENDERER_SHADER_ROOT
+   * @param fileName Name of the compiled shader, e.g. "mesh.vert.spv"
+   */
+  vk::UniqueShaderModule createShaderModule(Pipeline& pipeline, const std::string& fileName);
 
   // Build command buffer(s) for the current frame
   // Will read from mPerFrameData and mPerImageData
   void buildCommandBuffer(vk::CommandBuffer& commandBuffer, const vk::Framebuffer& frameBuffer);
+  /// Write the camera/lights for the current frame to the image's UBO
+  void updatePerFrameUBO();
+  /// Whether the current frame's draws will be recorded in parallel
+  bool useParallelRecording() const;
+
+  /// Memory flags for vertex/index buffers - Device local, host visible if unified memory
+  vk::MemoryPropertyFlags geometryMemoryFlags();
+  /// uploadBuffer, mUploadMutex must be held
+  void writeBuffer(SimpleBuffer& buffer, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset);
+
+  /// Timestamp queries, to measure gpu time of each frame
+  void createTimestampQueries();
+  void readTimestampQueries(uint32_t imageIndex);
   
   /// Initialise Descriptor pool, layouts for the renderer - Per-frame constants
   void initDescriptorSetsForRenderer();
   void createDescriptorSetsForRenderer();
 
-  /// Initialise descriptor pool, layouts for mesh data - Per-mesh constants (materials)
-  void initDescriptorSetsForMeshes();
-  void createDefaultDescriptorSetForMesh();
-  void createDescriptorSetForMesh(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material);
+  /// Create the material buffer, or replace it with a larger one
+  void createMaterialBuffer(uint32_t capacity);
+  /// Index of a material's entry in the material buffer, added with data if not already present
+  uint32_t materialIndex(const std::shared_ptr<Material>& material, const ShaderMaterialData& data);
+  /// Point an image's per-frame set at the material buffer
+  void writeMaterialDescriptor(uint32_t imageIndex);
+
+  /// Choose how the texture table is bound, and its size. Before the pipelines are created
+  void initTextureTable();
+  /// Create the white texture at index 0 of the texture table
+  void createDefaultTexture();
+  /// Write textures registered/released since the current image's table was last updated
+  /// Only called once the image's previous frame has completed
+  void updateTextureTable();
+  /// The texture table set for the current image
+  vk::DescriptorSet currentTextureSet() const;
+
+  /// Group the frame's mesh instances into draws, and write their instance data
+  void buildDrawGroups();
+  /// Ensure an image's frame data can hold count instances
+  void ensureInstanceCapacity(uint32_t imageIndex, uint32_t count);
+  /// Ensure an image's frame data can hold count indirect draws
+  void ensureIndirectCapacity(uint32_t imageIndex, uint32_t count);
+  /// Reset the current image's frame allocator, and allocate the frame's uniforms/instances/indirect commands
+  void allocateFrameData();
+  /// Point an image's per-frame descriptors at its frame allocator
+  void writeFrameDataDescriptors(uint32_t imageIndex);
+  /// Record the draws for drawGroups [first, last), either indirectly or one by one
+  void recordDraws(vk::CommandBuffer& commandBuffer, uint32_t first, uint32_t last);
+  /// Record the frame's draws into secondary command buffers, in parallel on the job system
+  /// @return The secondary command buffers, in order of execution
+  std::vector<vk::CommandBuffer> recordSecondaryCommandBuffers(const vk::Framebuffer& frameBuffer);
+  /// Create the per-chunk command pools for secondary command buffers
+  void createSecondaryCommandPools();
+  /// Record the culling pass, filling the indirect buffer with visible instances
+  /// Must be recorded outside of the render pass
+  void recordCulling(vk::CommandBuffer& commandBuffer);
 
   // Reference to the Engine, used to pass back window events/other renderer specific actions
   Engine& mEngine;
@@ -167,24 +350,51 @@ private:
   int mWindowWidth = 800;
   int mWindowHeight = 600;
 
+  // If headless there's no window, mWindowWidth/Height are
+  // the size of the offscreen images
+  bool mHeadless = false;
+  uint32_t mHeadlessImageCount = 3u;
+
+  std::string mPipelineCacheDirectory;
+
   // Our classes to obfuscate the verbosity of vulkan somewhat
   // Remember deletion order matters
   std::unique_ptr<DeviceInstance> mDeviceInstance;
   std::unique_ptr<WindowIntegration> mWindowIntegration;
   std::unique_ptr<FrameBuffer> mFrameBuffer;
   std::unique_ptr<GraphicsPipeline> mGraphicsPipeline;
+  std::unique_ptr<ComputePipeline> mCullPipeline;
 
   DeviceInstance::QueueRef* mQueue = nullptr;
 
-  // Descriptor pool for the renderer's per-frame data
-  vk::UniqueDescriptorPool mDescriptorPoolRenderer;
-
-  // Descriptor pool for per-mesh data (materials)
-  vk::UniqueDescriptorPool mDescriptorPoolMeshes;
+  // Descriptor sets for the renderer's per-frame data
+  std::unique_ptr<DescriptorAllocator> mDescriptorAllocator;
 
   vk::UniqueCommandPool mCommandPool;
   std::vector<vk::UniqueCommandBuffer> mCommandBuffers;
 
+  // Secondary command buffers for parallel recording
+  // A pool for each chunk of draws, for each swapchain image. Chunks rather than
+  // threads, as jobs may be executed by threads outside the job system (The engine thread)
+  // Pools are reset when the image is rendered to, buffers are reused
+  struct SecondaryCommandData {
+    vk::UniqueCommandPool pool;
+    vk::UniqueCommandBuffer buffer;
+  };
+  std::vector<std::vector<SecondaryCommandData>> mSecondaryCommandData;
+  // Recording is only split if there's enough draws to make it worthwhile
+  static constexpr uint32_t MIN_DRAWS_PER_SECONDARY = 128;
+
+  // Staging/submission of uploads, survives swapchain recreation
+  std::unique_ptr<UploadBatcher> mUploadBatcher;
+
+  // Vertex/index data for all meshes
+  std::unique_ptr<GeometryPool> mGeometryPool;
+
+  // Guards the upload batcher, geometry pool and queue submission
+  // Uploads may be made by the engine while the render thread is submitting
+  std::mutex mUploadMutex;
+
   // Data for each of the frames-in-flight
   // Vectors used here to maintain independent copies of the data
   // as we can't modify it when it's already in use for rendering
@@ -193,60 +403,228 @@ private:
     vk::UniqueSemaphore imageAvailableSem;
     vk::UniqueSemaphore renderFinishedSem;
     vk::UniqueFence     renderFinishedFence;
+    // Serial of the last frame submitted with this data, complete once the fence has been waited
+    uint64_t submittedSerial = 0u;
+    bool submitted = false;
   };
 
+  // What a command buffer was recorded with. If a frame's state matches the
+  // image's last recording the command buffer is resubmitted as-is
+  // Anything which is read from a buffer at execution time (Matrices, lights,
+  // indirect commands) isn't part of the state, only what's baked into the commands
+  struct DrawSignature {
+    uint32_t page = 0u;
+    // Draw parameters, only recorded directly if not using indirect draws
+    uint32_t indexCount = 0u;
+    uint32_t firstIndex = 0u;
+    int32_t vertexOffset = 0;
+    uint32_t firstInstance = 0u;
+    uint32_t instanceCount = 0u;
+
+    bool operator==(const DrawSignature&) const = default;
+  };
+  struct RecordedState {
+    bool valid = false;
+    vk::Pipeline pipeline;
+    vk::Framebuffer frameBuffer;
+    vk::DescriptorSet textureSet;
+    uint32_t descriptorGeneration = 0u; // See PerImageData::descriptorGeneration
+    std::array<uint32_t, 3> perFrameOffsets = {}; // Dynamic offsets of the per-frame set
+    uint32_t instanceCount = 0u; // Size of the culling dispatch
+    bool parallel = false;
+    std::vector<DrawSignature> draws;
+
+    bool operator==(const RecordedState&) const = default;
+  };
+  /// Capture the state the current frame would be recorded with
+  void captureRecordedState(RecordedState& state, const vk::Framebuffer& frameBuffer) const;
+
   // Data for each of the swapchains images
+  // Command buffers are per-image, so transient data follows the image rather than the
+  // frame in flight - A recorded buffer's dynamic offsets stay valid while the scene is unchanged
   struct PerImageData {
-    std::unique_ptr<SimpleBuffer> ubo; // Matrices, global frame data
-    vk::DescriptorSet uboDescriptor = {}; // Owned by pool
+    // Transient data written by the host each frame, reset once the image's previous frame has completed
+    // - UBOSetPerFrame: Matrices, global frame data
+    // - ShaderInstanceData for each instance in the frame, instanceCapacity allocated
+    // - vk::DrawIndexedIndirectCommand for each DrawGroup, written by the culling pass, indirectCapacity allocated
+    std::unique_ptr<FrameAllocator> frameData;
+    bool frameDescriptorsDirty = true; // The per-frame set's ranges don't match the allocator
+    uint32_t materialBufferGeneration = 0u; // mMaterialBufferGeneration when binding 4 was written
+    std::unique_ptr<SimpleBuffer> visibleBuffer; // Indices of the instances which passed gpu culling
+    uint32_t instanceCapacity = 0u;
+    uint32_t indirectCapacity = 0u;
+    vk::DescriptorSet uboDescriptor = {}; // Owned by mDescriptorAllocator
+    DescriptorAllocator::Allocation textureSet; // Texture table, only if not using descriptor indexing
+    uint32_t textureGeneration = 0u; // mTextureGeneration when textureSet was written
     vk::Fence fence = {}; // A fence, assigned from mFramesInFlight
+    bool timestampsWritten = false; // Whether the image's queries have been submitted
+    uint32_t descriptorGeneration = 0u; // Incremented when uboDescriptor is written, invalidating recorded commands
+    RecordedState recorded; // State of the last recording of the image's command buffer
   };
 
   uint32_t mMaxFramesInFlight = 2u;
 
+  // Initial size of each image's frame allocator, grows as needed
+  static constexpr vk::DeviceSize FRAME_DATA_SIZE = 1024 * 1024;
+  // Dynamic offsets must be aligned to these
+  vk::DeviceSize mUniformAlignment = 1u;
+  vk::DeviceSize mStorageAlignment = 1u;
+
+  // Whether draws are issued from the indirect buffer (Requires drawIndirectFirstInstance)
+  // and whether several can be issued at once (multiDrawIndirect)
+  bool mIndirectDraws = false;
+  bool mMultiDrawIndirect = false;
+  uint32_t mMaxDrawIndirectCount = 1u;
+  // Whether instances are frustum culled on the gpu, requires indirect draws
+  bool mGpuCulling = false;
+
   std::vector<PerFrameData> mPerFrameData;
   std::vector<PerImageData> mPerImageData;
 
-  // Push constants can be updated at any point however
-  vk::PushConstantRange mPushConstantSetRange;
+  // 2 timestamps per swapchain image, start and end of the frame
+  // Only valid if the queue supports timestamps
+  vk::UniqueQueryPool mTimestampQueryPool;
+  float mTimestampPeriod = 0.f;
+  FrameStats mFrameStats;
 
   // Members used to track data during the nodegraph traversal
   // render will happen once this is populated
   // An instruction to the renderer to draw the mesh
+  // The engine may modify the mesh/material while the frame is rendered, so everything
+  // the render thread needs is copied. The pointers only keep them alive, and identify them
   struct MeshRenderInstance {
     std::shared_ptr<Mesh> mesh;
+    std::shared_ptr<Material> material;
     glm::mat4x4 modelMatrix;
+    GeometryPool::Handle geometry;
+    glm::vec4 boundingSphere; // Model space, xyz == centre, w == radius
+    ShaderMaterialData materialData; // Used if the material isn't in the material buffer yet
   };
 
-  struct CurrentFrameData {
+  // Instances sharing a mesh, drawn with a single instanced draw
+  // Materials are looked up per-instance, so needn't match
+  // Instance data for the group is at [firstInstance, firstInstance + instanceCount)
+  struct DrawGroup {
+    std::shared_ptr<Mesh> mesh;
+    GeometryPool::Handle geometry; // Copied from the instances, not read from the mesh
+    // The geometry page's buffers, resolved while building as the engine may be adding pages
+    vk::Buffer vertexBuffer;
+    vk::Buffer indexBuffer;
+    uint32_t firstInstance = 0u;
+    uint32_t instanceCount = 0u;
+  };
+
+  // Everything the engine specifies for a frame, built between frameStart and frameEnd
+  // Once handed over the renderer owns it until the frame has been recorded
+  struct FrameSnapshot {
     // Global frame data
     glm::mat4x4 viewMatrix = glm::mat4x4(1.0f);
     glm::mat4x4 projectionMatrix = glm::mat4x4(1.0f);
     glm::vec3 eyePos = {0.f,0.f,0.f};
+    // Serial of the frame, releases made while it was built are collected once it has completed
+    uint64_t serial = 0u;
 
     // The meshes and lights to render in the frame
-    std::list<MeshRenderInstance> meshesToRender;
+    // Meshes are logged per job system thread (By threadIndex), and merged into meshesToRender by buildDrawGroups
+    std::vector<std::vector<MeshRenderInstance>> threadMeshes;
+    std::vector<MeshRenderInstance> meshesToRender;
     std::vector<ShaderLightData> lightsToRender;
+    // Materials passed to releaseMaterial during the frame
+    std::vector<std::shared_ptr<Material>> materialsToRelease;
+  };
+
+  // Double buffered, the engine builds one while the render thread renders the other
+  FrameSnapshot mSnapshots[2];
+  // Snapshot being built by the engine
+  uint32_t mBuildSnapshot = 0u;
+  // Snapshot handed to the render thread, NO_SNAPSHOT once it's been rendered
+  static constexpr int32_t NO_SNAPSHOT = -1;
+  static constexpr int32_t QUIT_RENDER_THREAD = -2;
+  std::atomic<int32_t> mPendingSnapshot = NO_SNAPSHOT;
+  std::thread mRenderThread;
+  // Thrown while rendering, passed back to the engine at the next frameEnd
+  std::exception_ptr mRenderThreadException;
+
+  /// Wait for, acquire, record and submit a frame. Called on the render thread if running
+  void renderFrame(FrameSnapshot& snapshot);
+  void renderThreadLoop();
+  /// Block until the render thread has finished with its snapshot
+  void waitForRenderThread();
+  /// Free the resources of a material, once the frames using them have completed
+  void destroyMaterialData(std::shared_ptr<Material> material);
+
+  // State of the frame being rendered, only accessed while rendering
+  struct CurrentFrameData {
+    // The frame being rendered
+    FrameSnapshot* snapshot = nullptr;
+    // snapshot's meshes grouped by mesh/material, populated at the end of the frame
+    std::vector<DrawGroup> drawGroups;
+    // Material buffer index of each of snapshot's meshes, after sorting
+    std::vector<uint32_t> materialIndices;
+    // The frame's allocations from the image's frame allocator
+    FrameAllocator::Range uboRange;
+    FrameAllocator::Range instanceRange;
+    FrameAllocator::Range indirectRange;
+    // Dynamic offsets for bindings 0-2 of the per-frame set
+    std::array<uint32_t, 3> perFrameOffsets = {};
+    // State for the frame's command buffer, swapped with the image's when recorded
+    RecordedState recordState;
 
     // Tracking of which frame we're on, and which image the frame is rendering to
     uint32_t frameIndex = 0u;
     uint32_t imageIndex = 0u;
+    // If headless the next offscreen image to render to
+    uint32_t headlessImageIndex = 0u;
   } mCurrentFrameData;
 
-  // Shader/Material resources for each rendered mesh
-  // TODO: Will be shared between frames, assumed to never be cleared
-  struct MeshRenderData {
-    vk::DescriptorSet descriptorSet;
-    std::unique_ptr<SimpleBuffer> uboMaterial;
+  // ShaderMaterialData for every rendered material, converted once when first rendered
+  // Shared by all frames, entries are only written when added so in-flight frames are unaffected
+  std::unique_ptr<SimpleBuffer> mMaterialBuffer;
+  ShaderMaterialData* mMaterialData = nullptr; // mMaterialBuffer, mapped for its lifetime
+  uint32_t mMaterialCapacity = 0u;
+  uint32_t mMaterialCount = 0u; // Entries used, including any free ones
+  std::vector<uint32_t> mFreeMaterialIndices;
+  std::map<std::shared_ptr<Material>, uint32_t> mMaterialIndices;
+  // Incremented when the material buffer is replaced, each image's descriptor is updated to match
+  uint32_t mMaterialBufferGeneration = 0u;
+  // Used for meshes rendered without a material
+  std::shared_ptr<Material> mDefaultMaterial;
+  // Lights may be rendered from multiple threads
+  std::mutex mLightMutex;
+
+  // Textures addressed by index from the shaders, set 1
+  // With descriptor indexing the table is a single update-after-bind set shared by all images,
+  // partially bound and replaced by a larger one as needed. New entries are written while frames are in flight
+  // Otherwise each image has a fixed size set, fully written (Unused entries with the default texture)
+  // when the table has changed and the image's previous frame has completed
+  struct TextureEntry {
+    vk::ImageView view;
+    vk::Sampler sampler;
   };
-  std::map<std::shared_ptr<Mesh>, MeshRenderData> mMeshRenderData;
-
-  // Default/placeholder material
-  std::unique_ptr<SimpleBuffer> mUBOMeshDataDefault;
-  vk::DescriptorSet mDescriptorSetMeshDataDefault;
-
-  // Flag set by on GLFWFramebufferSize
-  // Checked during rendering to trigger swapchain recreation
+  bool mBindlessTextures = false;
+  uint32_t mMaxTextures = 1u; // Array size in the set layout
+  std::unique_ptr<DescriptorAllocator> mTextureDescriptors;
+  DescriptorAllocator::Allocation mTextureSet; // Bindless only
+  uint32_t mTextureSetCapacity = 0u; // Bindless only, variable descriptor count of mTextureSet
+  // Guards the table's entries, textures may be registered while the render thread is updating the sets
+  std::mutex mTextureMutex;
+  std::vector<TextureEntry> mTextures; // Released entries are empty
+  std::vector<uint32_t> mFreeTextureIndices;
+  std::vector<uint32_t> mDirtyTextures; // Bindless only, entries not yet written to mTextureSet
+  uint32_t mTextureGeneration = 0u; // Incremented whenever an entry changes
+  std::unique_ptr<SimpleImage> mDefaultTexture;
+  vk::UniqueSampler mDefaultSampler;
+
+  // Resources released by the application, destroyed once the frames which may use them have completed
+  // Each frame is given a serial by frameEnd, releases are made against the frame being built
+  // Releases from the render thread are held until the frame after the one it's rendering
+  DeletionQueue mDeletionQueue;
+  std::atomic<uint64_t> mBuildSerial = 0u;
+  // Set on release, as the resource may be referenced by a recorded command buffer
+  std::atomic<bool> mResourcesReleased = false;
+
+  // Flag set by on GLFWFramebufferSize, or when the swapchain is out of date
+  // Checked by frameEnd to trigger swapchain recreation, while the render thread is idle
   std::atomic<bool> mRecreateSwapChainSoon = false;
 };
 
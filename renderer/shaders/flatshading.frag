@@ -14,9 +14,10 @@ layout(location = 0) in vec3 inPosWorld;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inUV0;
 layout(location = 3) in vec2 inUV1;
+layout(location = 4) flat in uint inMaterialIndex;
 
 layout(location = 0) out vec4 outColour;
 
 void main() {
-  outColour = uboMaterial.baseColourFactor;
+  outColour = ssboMaterials.materials[inMaterialIndex].baseColourFactor;
 }
@@ -22,21 +22,25 @@ layout(location = 0) out vec3 outPosWorld;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec2 outUV0;
 layout(location = 3) out vec2 outUV1;
+layout(location = 4) flat out uint outMaterialIndex;
 
 void main() {
   // TODO: Skinning/Joint handling would go here, see https://github.com/SaschaWillems/Vulkan-glTF-PBR/blob/master/data/shaders/pbr.vert
 
-  vec4 worldPos = matrices.model * vec4(inPosition, 1.0);
+  uint instanceIndex = gpuCulling ? ssboVisibleInstances.indices[gl_InstanceIndex] : uint(gl_InstanceIndex);
+  mat4 model = ssboInstances.instances[instanceIndex].model;
+  vec4 worldPos = model * vec4(inPosition, 1.0);
   outPosWorld = worldPos.xyz;
 
   // Lighting calculations are performed in world space
   // This uses the 'normal matrix' which scales/rotates correctly for the normals
   // TODO: Should move normal matrix to cpu side, quit being wasteful here
-  mat3 normalMatrix = transpose(inverse(mat3(uboPerFrame.viewMatrix * matrices.model)));
+  mat3 normalMatrix = transpose(inverse(mat3(uboPerFrame.viewMatrix * model)));
   outNormal = normalMatrix * inNormal;
 
   outUV0 = inUV0;
   outUV1 = inUV1;
+  outMaterialIndex = ssboInstances.instances[instanceIndex].materialIndex;
 
   gl_Position = uboPerFrame.projectionMatrix * uboPerFrame.viewMatrix * worldPos;
 }
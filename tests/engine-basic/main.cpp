@@ -1,5 +1,6 @@
 
 #include "engine.h"
+#include "renderer.h"
 
 #include "meshnode.h"
 #include "loaders/gltfloader.h"
@@ -11,14 +12,35 @@
 
 int main(int argc, char* argv[])
 {
+  // Usage: test-engine-basic [--headless numFrames] [--serial-update] [--inline-render] [--pipeline-cache dir] [model.gltf]
   std::string modelFile;
-  if( argc > 1 ) {
-      modelFile = argv[1];
+  std::string pipelineCacheDir;
+  bool headless = false;
+  bool serialUpdate = false;
+  bool inlineRender = false;
+  uint64_t headlessFrames = 0u;
+  for( auto i = 1; i < argc; ++i ) {
+    std::string arg = argv[i];
+    if( arg == "--headless" && i + 1 < argc ) {
+      headless = true;
+      headlessFrames = std::stoull(argv[++i]);
+    } else if( arg == "--serial-update" ) {
+      serialUpdate = true;
+    } else if( arg == "--inline-render" ) {
+      inlineRender = true;
+    } else if( arg == "--pipeline-cache" && i + 1 < argc ) {
+      pipelineCacheDir = argv[++i];
+    } else {
+      modelFile = arg;
+    }
   }
 
   try {
     // Create the engine, window, renderer, etc.
-    Engine eng;
+    Engine eng(headless);
+    if( serialUpdate ) eng.updateMode(Engine::UpdateMode::Serial);
+    if( inlineRender ) eng.renderMode(Engine::RenderMode::Inline);
+    eng.renderer().pipelineCacheDirectory(pipelineCacheDir);
 
     // Load some data into the scene
     if( !modelFile.empty() ) {
@@ -28,14 +50,14 @@ int main(int argc, char* argv[])
             return EXIT_FAILURE;
         }
         modelNode->updateScript([](Engine&, Node& n, double deltaT) {
-           n.rotation() = n.rotation() + glm::vec3(0.0, deltaT * 1.0, 0.0);
-        });
+           n.rotation(n.rotation() + glm::vec3(0.0, deltaT * 1.0, 0.0));
+        }, Node::ScriptScope::Subtree);
         eng.nodegraph()->children().emplace_back(modelNode);
     } else {
         std::shared_ptr<MeshNode> dummyMesh(new MeshNode());
         dummyMesh->updateScript([](Engine&, Node& n, double deltaT){
-            n.rotation() = n.rotation() + glm::vec3(0.0, 0.0, deltaT * 1.0);
-        });
+            n.rotation(n.rotation() + glm::vec3(0.0, 0.0, deltaT * 1.0));
+        }, Node::ScriptScope::Subtree);
         eng.nodegraph()->children().emplace_back(dummyMesh);
     }
 
@@ -78,9 +100,35 @@ int main(int argc, char* argv[])
         e.camera().projectionPerspective(glm::radians(50.f), e.windowWidth() / e.windowHeight(), 0.1f, 1000.0f);
     });
 
+    // If headless there's no window to close, run for a fixed number of frames instead
+    if( headless ) {
+      eng.nodegraph()->children().emplace_back(new Node());
+      eng.nodegraph()->children().back()->updateScript([headlessFrames](Engine& e, Node&, double) {
+        if( e.frameCount() >= headlessFrames ) {
+          // The device is destroyed during shutdown, report its stats while it's still alive
+          auto& dev = e.renderer().deviceInstance();
+          std::cout << "Pipelines built in " << dev.pipelineBuildTime() << "ms ("
+                    << (dev.pipelineCacheWarm() ? "warm" : "cold") << " start)" << std::endl;
+          dev.allocator().printStats(std::cout);
+          e.quit();
+        }
+      });
+    }
+
     // Start the engine!
     eng.run();
 
+    if( headless ) {
+      auto& stats = eng.renderer().frameStats();
+      auto frames = eng.frameCount();
+      auto elapsed = eng.elapsedTime();
+      std::cout << "Headless: " << frames << " frames in " << elapsed << "s (" << (elapsed > 0.0 ? frames / elapsed : 0.0) << " fps)\n"
+                << "  CPU frame time (avg): " << (frames ? 1000.0 * elapsed / frames : 0.0) << "ms\n"
+                << "  GPU frame time (avg): " << (stats.gpuFramesTimed ? stats.totalGpuFrameTime / stats.gpuFramesTimed : 0.0) << "ms\n"
+                << "  Command buffers reused: " << stats.framesReused << "/" << stats.framesSubmitted << std::endl;
+      eng.jobs().printStats(std::cout);
+    }
+
   } catch ( std::exception& e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
@@ -0,0 +1,61 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "deletionqueue.h"
+
+DeletionQueue::DeletionQueue() {}
+
+DeletionQueue::~DeletionQueue() {
+  clear();
+}
+
+void DeletionQueue::defer(uint64_t frame, Function fn) {
+  push(frame, std::unique_ptr<Entry>(new FunctionEntry(std::move(fn))));
+}
+
+void DeletionQueue::push(uint64_t frame, std::unique_ptr<Entry> entry) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  // Frames only move forwards, so only the newest bucket can match
+  // A release for an older frame is held until the newest bucket's frame, which is later so still safe
+  if( mBuckets.empty() || mBuckets.back().frame < frame ) {
+    Bucket b;
+    b.frame = frame;
+    mBuckets.emplace_back(std::move(b));
+  }
+  mBuckets.back().entries.emplace_back(std::move(entry));
+}
+
+void DeletionQueue::collect(uint64_t frame) {
+  // Entries are destroyed outside the lock, so their destructors may release more resources
+  std::deque<Bucket> completed;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    while( !mBuckets.empty() && mBuckets.front().frame <= frame ) {
+      completed.emplace_back(std::move(mBuckets.front()));
+      mBuckets.pop_front();
+    }
+  }
+}
+
+void DeletionQueue::clear() {
+  // Destroying one entry may release another, repeat until empty
+  while( true ) {
+    std::deque<Bucket> all;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if( mBuckets.empty() ) return;
+      std::swap(all, mBuckets);
+    }
+  }
+}
+
+size_t DeletionQueue::size() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  size_t n = 0u;
+  for( auto& b : mBuckets ) n += b.entries.size();
+  return n;
+}
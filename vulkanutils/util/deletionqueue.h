@@ -0,0 +1,87 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef DELETIONQUEUE_H
+#define DELETIONQUEUE_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Deferred destruction of resources which may still be in use by the gpu
+ * - Resources are released against a frame serial, the frame being built when they were released
+ * - Once the owner knows that frame has completed (Its fence has signalled) it calls collect,
+ *   destroying anything released up to and including the frame
+ *
+ * Any owning type can be released (std::unique_ptr<SimpleBuffer>, vk::UniquePipeline, etc),
+ * it's destroyed by collect. Resources which need more than a destructor
+ * (Returning a descriptor set to its pool) can use defer instead.
+ *
+ * Releases are thread safe, collect/clear must only be called by the owner.
+ */
+class DeletionQueue
+{
+public:
+  using Function = std::function<void()>;
+
+  DeletionQueue();
+  ~DeletionQueue();
+
+  /// Take ownership of a resource, destroyed once frame has completed
+  template<typename T>
+  void release(uint64_t frame, T resource) {
+    push(frame, std::unique_ptr<Entry>(new ResourceEntry<T>(std::move(resource))));
+  }
+
+  /// Call a function once frame has completed
+  void defer(uint64_t frame, Function fn);
+
+  /// Destroy everything released during frames up to and including frame
+  void collect(uint64_t frame);
+
+  /// Destroy everything, the device must be idle
+  void clear();
+
+  /// Number of resources pending destruction
+  size_t size() const;
+
+private:
+  DeletionQueue(const DeletionQueue&) = delete;
+  DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+  struct Entry {
+    virtual ~Entry() {}
+  };
+  template<typename T>
+  struct ResourceEntry final : public Entry {
+    ResourceEntry(T r) : resource(std::move(r)) {}
+    T resource;
+  };
+  struct FunctionEntry final : public Entry {
+    FunctionEntry(Function f) : fn(std::move(f)) {}
+    ~FunctionEntry() final override { if( fn ) fn(); }
+    Function fn;
+  };
+
+  // Everything released during a single frame
+  struct Bucket {
+    uint64_t frame = 0u;
+    std::vector<std::unique_ptr<Entry>> entries;
+  };
+
+  void push(uint64_t frame, std::unique_ptr<Entry> entry);
+
+  mutable std::mutex mMutex;
+  // In order of frame
+  std::deque<Bucket> mBuckets;
+};
+
+#endif
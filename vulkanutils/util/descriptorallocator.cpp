@@ -0,0 +1,90 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "descriptorallocator.h"
+
+#include "deviceinstance.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+DescriptorAllocator::DescriptorAllocator(DeviceInstance& deviceInstance, std::vector<vk::DescriptorPoolSize> sizesPerSet,
+                                         uint32_t initialSets, vk::DescriptorPoolCreateFlags flags)
+  : mDeviceInstance(deviceInstance)
+  , mSizesPerSet(std::move(sizesPerSet))
+  , mFlags(flags | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet)
+  , mNextPoolSets(std::max(initialSets, 1u))
+{
+  if( mSizesPerSet.empty() ) throw std::runtime_error("DescriptorAllocator: No descriptor types specified");
+}
+
+DescriptorAllocator::~DescriptorAllocator() {
+  mPools.clear();
+}
+
+DescriptorAllocator::Allocation DescriptorAllocator::allocate(vk::DescriptorSetLayout layout, uint32_t variableCount) {
+  Allocation result;
+  for( auto it = mPools.rbegin(); it != mPools.rend(); ++it ) {
+    if( tryAllocate(it->get(), layout, variableCount, result.set) ) {
+      result.pool = it->get();
+      return result;
+    }
+  }
+
+  // All pools are full (Or too fragmented), add a larger one
+  auto pool = createPool(variableCount);
+  if( !tryAllocate(pool, layout, variableCount, result.set) ) {
+    throw std::runtime_error("DescriptorAllocator::allocate: Failed to allocate from a new pool, sizesPerSet doesn't match the layout");
+  }
+  result.pool = pool;
+  return result;
+}
+
+void DescriptorAllocator::free(Allocation& allocation) {
+  if( !allocation.set ) return;
+  mDeviceInstance.device().freeDescriptorSets(allocation.pool, 1, &allocation.set);
+  allocation = {};
+}
+
+void DescriptorAllocator::reset() {
+  for( auto& p : mPools ) mDeviceInstance.device().resetDescriptorPool(p.get());
+}
+
+bool DescriptorAllocator::tryAllocate(vk::DescriptorPool pool, vk::DescriptorSetLayout layout, uint32_t variableCount, vk::DescriptorSet& set) {
+  auto variableInfo = vk::DescriptorSetVariableDescriptorCountAllocateInfoEXT()
+      .setDescriptorSetCount(1)
+      .setPDescriptorCounts(&variableCount);
+  auto info = vk::DescriptorSetAllocateInfo()
+      .setDescriptorPool(pool)
+      .setDescriptorSetCount(1)
+      .setPSetLayouts(&layout)
+      .setPNext(variableCount ? &variableInfo : nullptr);
+
+  auto res = mDeviceInstance.device().allocateDescriptorSets(&info, &set);
+  if( res == vk::Result::eSuccess ) return true;
+  // Before vk 1.1 (VK_KHR_maintenance1) a full pool may report any error
+  // For anything unexpected let the next pool try, a new pool failing will throw
+  if( res == vk::Result::eErrorOutOfPoolMemory || res == vk::Result::eErrorFragmentedPool ||
+      res == vk::Result::eErrorOutOfDeviceMemory || res == vk::Result::eErrorOutOfHostMemory ) return false;
+  throw std::runtime_error("DescriptorAllocator::allocate: Failed to allocate descriptor set: " + vk::to_string(res));
+}
+
+vk::DescriptorPool DescriptorAllocator::createPool(uint32_t variableCount) {
+  auto sets = mNextPoolSets;
+  mNextPoolSets *= 2;
+
+  auto sizes = mSizesPerSet;
+  for( auto& s : sizes ) s.descriptorCount = s.descriptorCount * sets + variableCount;
+
+  auto info = vk::DescriptorPoolCreateInfo()
+      .setFlags(mFlags)
+      .setMaxSets(sets)
+      .setPoolSizeCount(static_cast<uint32_t>(sizes.size()))
+      .setPPoolSizes(sizes.data());
+  mPools.emplace_back(mDeviceInstance.device().createDescriptorPoolUnique(info));
+  return mPools.back().get();
+}
@@ -0,0 +1,78 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef DESCRIPTORALLOCATOR_H
+#define DESCRIPTORALLOCATOR_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class DeviceInstance;
+
+/**
+ * Growable allocator for descriptor sets
+ * - Sets are allocated from a list of pools, when all of them are full another pool is created
+ * - Each new pool holds twice as many sets as the last, so the number of pools stays small
+ *   however many sets are needed
+ * - Pools are sized by the descriptors of each type a set needs, multiplied by the number of sets
+ *
+ * Sets may be freed individually, returning their space to the pool they came from.
+ * Not thread safe, the owner must synchronise access.
+ */
+class DescriptorAllocator
+{
+public:
+  /// A set, and the pool it was allocated from
+  struct Allocation {
+    vk::DescriptorSet set;
+    vk::DescriptorPool pool;
+  };
+
+  /**
+   * @param sizesPerSet Descriptors of each type needed by a single set
+   * @param initialSets Number of sets in the first pool
+   * @param flags Pool flags, such as eUpdateAfterBindEXT. eFreeDescriptorSet is always set
+   */
+  DescriptorAllocator(DeviceInstance& deviceInstance, std::vector<vk::DescriptorPoolSize> sizesPerSet,
+                      uint32_t initialSets = 64, vk::DescriptorPoolCreateFlags flags = {});
+  ~DescriptorAllocator();
+
+  /**
+   * Allocate a set, creating a new pool if the existing ones are full
+   * @param variableCount Size of the layout's variable sized binding, if it has one (Requires descriptor indexing)
+   *                      Reserved in addition to sizesPerSet for each descriptor type when a pool is created
+   */
+  Allocation allocate(vk::DescriptorSetLayout layout, uint32_t variableCount = 0);
+
+  /// Return a set to its pool, the gpu must have finished with it
+  void free(Allocation& allocation);
+
+  /// Free all sets, the gpu must have finished with them. Pools are kept for reuse
+  void reset();
+
+  /// Number of pools created
+  uint32_t poolCount() const { return static_cast<uint32_t>(mPools.size()); }
+
+private:
+  DescriptorAllocator(const DescriptorAllocator&) = delete;
+  DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+  /// Try to allocate from a pool, returns false if the pool is full
+  bool tryAllocate(vk::DescriptorPool pool, vk::DescriptorSetLayout layout, uint32_t variableCount, vk::DescriptorSet& set);
+  vk::DescriptorPool createPool(uint32_t variableCount);
+
+  DeviceInstance& mDeviceInstance;
+  std::vector<vk::DescriptorPoolSize> mSizesPerSet;
+  vk::DescriptorPoolCreateFlags mFlags;
+  uint32_t mNextPoolSets = 0u;
+  // Newest last, allocations try the newest (Largest) pool first
+  std::vector<vk::UniqueDescriptorPool> mPools;
+};
+
+#endif
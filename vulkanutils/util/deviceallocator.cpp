@@ -0,0 +1,173 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "deviceallocator.h"
+
+#include "deviceinstance.h"
+
+#include <algorithm>
+
+DeviceAllocator::DeviceAllocator(DeviceInstance& deviceInstance, vk::DeviceSize blockSize)
+  : mDeviceInstance(deviceInstance)
+  , mBlockSize(blockSize)
+{
+  mMemoryProperties = mDeviceInstance.physicalDevice().getMemoryProperties();
+  mNonCoherentAtomSize = std::max(vk::DeviceSize(1), mDeviceInstance.physicalDevice().getProperties().limits.nonCoherentAtomSize);
+}
+
+DeviceAllocator::~DeviceAllocator() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mBlocks.clear();
+}
+
+DeviceAllocator::Allocation DeviceAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags memFlags, bool linear) {
+  auto memoryType = mDeviceInstance.selectDeviceMemoryHeap(requirements, memFlags);
+  auto typeFlags = mMemoryProperties.memoryTypes[memoryType].propertyFlags;
+
+  // Host writes to non-coherent memory are flushed in units of nonCoherentAtomSize,
+  // keep allocations aligned to that so a flush never touches a neighbour
+  auto alignment = std::max(requirements.alignment, vk::DeviceSize(1));
+  if( (typeFlags & vk::MemoryPropertyFlagBits::eHostVisible) &&
+     !(typeFlags & vk::MemoryPropertyFlagBits::eHostCoherent) ) {
+    alignment = std::max(alignment, mNonCoherentAtomSize);
+  }
+
+  // Blocks shouldn't take too much of a small heap (BAR memory is often only 256MB)
+  auto heapSize = mMemoryProperties.memoryHeaps[mMemoryProperties.memoryTypes[memoryType].heapIndex].size;
+  auto blockSize = std::min(mBlockSize, std::max(heapSize / 8, vk::DeviceSize(1)));
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  Block* block = nullptr;
+  vk::DeviceSize offset = RangeAllocator::invalidOffset;
+
+  if( requirements.size > blockSize / 2 ) {
+    block = createBlock(memoryType, requirements.size, linear, true);
+    offset = block->ranges.allocate(requirements.size, alignment);
+  } else {
+    for( auto& b : mBlocks ) {
+      if( b->dedicated || b->memoryType != memoryType || b->linear != linear ) continue;
+      offset = b->ranges.allocate(requirements.size, alignment);
+      if( offset != RangeAllocator::invalidOffset ) {
+        block = b.get();
+        break;
+      }
+    }
+    if( !block ) {
+      block = createBlock(memoryType, blockSize, linear, false);
+      offset = block->ranges.allocate(requirements.size, alignment);
+    }
+  }
+  if( offset == RangeAllocator::invalidOffset ) throw std::runtime_error("DeviceAllocator::allocate: Failed to allocate from new block");
+
+  block->allocationCount++;
+
+  Allocation result;
+  result.memory = block->memory.get();
+  result.offset = offset;
+  result.size = requirements.size;
+  result.memoryType = memoryType;
+  result.memoryFlags = block->memoryFlags;
+  result.mapped = block->mapped ? static_cast<uint8_t*>(block->mapped) + offset : nullptr;
+  result.block = block;
+  return result;
+}
+
+void DeviceAllocator::free(Allocation& allocation) {
+  if( !allocation.block ) return;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto block = allocation.block;
+  block->ranges.free(allocation.offset, allocation.size);
+  block->allocationCount--;
+  allocation = Allocation();
+
+  if( block->allocationCount > 0 ) return;
+
+  // Dedicated blocks go straight away. For shared blocks keep one
+  // empty block around per type, to avoid thrashing the driver
+  if( !block->dedicated ) {
+    auto emptyBlocks = std::count_if(mBlocks.begin(), mBlocks.end(), [&](auto& b) {
+      return !b->dedicated && b->allocationCount == 0 &&
+             b->memoryType == block->memoryType && b->linear == block->linear;
+    });
+    if( emptyBlocks < 2 ) return;
+  }
+  destroyBlock(block);
+}
+
+void DeviceAllocator::flush(const Allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) {
+  if( !allocation.block ) return;
+  if( allocation.memoryFlags & vk::MemoryPropertyFlagBits::eHostCoherent ) return;
+  if( size == 0 ) return;
+  if( size == VK_WHOLE_SIZE ) size = allocation.size - offset;
+
+  auto blockSize = allocation.block->ranges.size();
+  auto start = allocation.offset + offset;
+  auto end = start + size;
+  start = (start / mNonCoherentAtomSize) * mNonCoherentAtomSize;
+  end = ((end + mNonCoherentAtomSize - 1) / mNonCoherentAtomSize) * mNonCoherentAtomSize;
+  if( end > blockSize ) end = blockSize;
+
+  mDeviceInstance.flushMemoryRanges({vk::MappedMemoryRange(allocation.memory, start, end - start)});
+}
+
+DeviceAllocator::Stats DeviceAllocator::stats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  Stats s;
+  vk::DeviceSize freeBytes = 0;
+  for( auto& b : mBlocks ) {
+    s.blockCount++;
+    if( b->dedicated ) s.dedicatedBlockCount++;
+    s.allocationCount += b->allocationCount;
+    s.blockBytes += b->ranges.size();
+    s.liveBytes += b->ranges.used();
+    s.freeRegionCount += b->ranges.freeRegionCount();
+    s.largestFreeRegion = std::max(s.largestFreeRegion, b->ranges.largestFreeRegion());
+    freeBytes += b->ranges.size() - b->ranges.used();
+  }
+  if( freeBytes ) s.fragmentation = 1.0f - static_cast<float>(s.largestFreeRegion) / static_cast<float>(freeBytes);
+  return s;
+}
+
+void DeviceAllocator::printStats(std::ostream& stream) const {
+  auto s = stats();
+  stream << "Device memory:\n"
+         << "  Blocks: " << s.blockCount << " (" << s.dedicatedBlockCount << " dedicated)\n"
+         << "  Allocations: " << s.allocationCount << "\n"
+         << "  Allocated: " << s.blockBytes << " bytes\n"
+         << "  Live: " << s.liveBytes << " bytes\n"
+         << "  Free regions: " << s.freeRegionCount << " (largest " << s.largestFreeRegion << " bytes)\n"
+         << "  Fragmentation: " << s.fragmentation << std::endl;
+}
+
+DeviceAllocator::Block* DeviceAllocator::createBlock(uint32_t memoryType, vk::DeviceSize size, bool linear, bool dedicated) {
+  auto info = vk::MemoryAllocateInfo()
+      .setAllocationSize(size)
+      .setMemoryTypeIndex(memoryType);
+
+  auto block = std::make_unique<Block>(size);
+  block->memory = mDeviceInstance.device().allocateMemoryUnique(info);
+  block->memoryType = memoryType;
+  block->memoryFlags = mMemoryProperties.memoryTypes[memoryType].propertyFlags;
+  block->linear = linear;
+  block->dedicated = dedicated;
+
+  if( block->memoryFlags & vk::MemoryPropertyFlagBits::eHostVisible ) {
+    block->mapped = mDeviceInstance.mapMemory(block->memory.get(), 0, VK_WHOLE_SIZE);
+  }
+
+  mBlocks.emplace_back(std::move(block));
+  return mBlocks.back().get();
+}
+
+void DeviceAllocator::destroyBlock(Block* block) {
+  auto it = std::find_if(mBlocks.begin(), mBlocks.end(), [&](auto& b) { return b.get() == block; });
+  if( it == mBlocks.end() ) return;
+  // Memory is implicitly unmapped when freed
+  mBlocks.erase(it);
+}
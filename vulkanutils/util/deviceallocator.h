@@ -0,0 +1,120 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef DEVICEALLOCATOR_H
+#define DEVICEALLOCATOR_H
+
+#include <vulkan/vulkan.hpp>
+
+#include "rangeallocator.h"
+
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+class DeviceInstance;
+
+/**
+ * Sub-allocation of device memory
+ * - Memory is allocated from the driver in large blocks, one set of blocks per memory type
+ * - Resources are placed within a block, with a free list tracking the gaps
+ * - Allocations larger than half a block get a dedicated block
+ * - Linear (buffer) and optimal (image) resources never share a block,
+ *   so bufferImageGranularity doesn't need to be considered
+ * - Host visible blocks are mapped once on creation and stay mapped
+ *
+ * Owned by the DeviceInstance, SimpleBuffer/SimpleImage use it by default.
+ */
+class DeviceAllocator
+{
+public:
+  struct Block;
+
+  /// A range of device memory, as returned by allocate
+  struct Allocation {
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    uint32_t memoryType = 0;
+    vk::MemoryPropertyFlags memoryFlags;
+    /// Host pointer to the start of the allocation, nullptr if memory isn't host visible
+    void* mapped = nullptr;
+
+    /// The block the allocation came from, for use by the allocator
+    Block* block = nullptr;
+
+    operator bool() const { return block != nullptr; }
+  };
+
+  struct Stats {
+    uint32_t blockCount = 0;
+    uint32_t dedicatedBlockCount = 0;
+    uint32_t allocationCount = 0;
+    /// Memory allocated from the driver
+    vk::DeviceSize blockBytes = 0;
+    /// Memory in use by allocations
+    vk::DeviceSize liveBytes = 0;
+    uint32_t freeRegionCount = 0;
+    vk::DeviceSize largestFreeRegion = 0;
+    /// 0 if free space is contiguous, approaching 1 as it becomes split into small gaps
+    float fragmentation = 0.0f;
+  };
+
+  struct Block {
+    vk::UniqueDeviceMemory memory;
+    uint32_t memoryType = 0;
+    vk::MemoryPropertyFlags memoryFlags;
+    bool linear = true;
+    bool dedicated = false;
+    void* mapped = nullptr;
+    RangeAllocator ranges;
+    uint32_t allocationCount = 0;
+
+    Block(vk::DeviceSize size) : ranges(size) {}
+  };
+
+  DeviceAllocator(DeviceInstance& deviceInstance, vk::DeviceSize blockSize = 64 * 1024 * 1024);
+  ~DeviceAllocator();
+
+  /**
+   * Allocate memory
+   * @param requirements As reported by the buffer/image
+   * @param memFlags Required memory properties
+   * @param linear true for buffers/linear images, false for optimal tiling images
+   */
+  Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags memFlags, bool linear);
+
+  /// Release an allocation, the allocation is reset
+  void free(Allocation& allocation);
+
+  /**
+   * Flush a range within a host visible allocation
+   * offset is relative to the allocation, range is expanded to nonCoherentAtomSize
+   * Nothing to do if the memory is host coherent
+   */
+  void flush(const Allocation& allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+
+  Stats stats() const;
+  void printStats(std::ostream& stream) const;
+
+private:
+  DeviceAllocator() = delete;
+
+  Block* createBlock(uint32_t memoryType, vk::DeviceSize size, bool linear, bool dedicated);
+  void destroyBlock(Block* block);
+
+  DeviceInstance& mDeviceInstance;
+  vk::DeviceSize mBlockSize;
+  vk::PhysicalDeviceMemoryProperties mMemoryProperties;
+  vk::DeviceSize mNonCoherentAtomSize = 1;
+
+  mutable std::mutex mMutex;
+  std::vector<std::unique_ptr<Block>> mBlocks;
+};
+
+#endif
@@ -7,8 +7,16 @@
 
 #include "deviceinstance.h"
 
+#include "deviceallocator.h"
 #include "util.h"
 
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
 DeviceInstance::DeviceInstance(
     const std::vector<const char*>& requiredInstanceExtensions,
     const std::vector<const char*>& requiredDeviceExtensions,
@@ -17,13 +25,19 @@ DeviceInstance::DeviceInstance(
     uint32_t vulkanApiVer,
     std::vector<vk::QueueFlags> qFlags,
     const std::vector<const char*>& enabledLayers) {
+  mApiVersion = vulkanApiVer;
   createVulkanInstance(requiredInstanceExtensions, appName, appVer, vulkanApiVer, enabledLayers);
   // TODO: Need to split device and queue creation apart
-  createLogicalDevice(qFlags);
+  createLogicalDevice(qFlags, requiredDeviceExtensions);
+  mAllocator.reset(new DeviceAllocator(*this));
+  mPipelineCache = mDevice->createPipelineCacheUnique(vk::PipelineCacheCreateInfo());
 }
 
 DeviceInstance::~DeviceInstance() {
   // Make sure the debug callback has been cleaned up before the vulkan instance
+  // and any memory blocks have been released before the device
+  mAllocator.reset();
+  mPipelineCache.reset();
   mDevice.reset();
   Util::reset();
   mInstance.reset();
@@ -66,6 +80,12 @@ void DeviceInstance::createVulkanInstance(const std::vector<const char*>& requir
   auto numLayers = static_cast<uint32_t>(instanceLayers.size());
   for( auto& e : enabledInstanceExtensions ) Util::ensureExtension(supportedExtensions, e);
 
+  // Presentation is only possible if the caller asked for a surface extension
+  // Headless applications (offscreen rendering) won't have one
+  mSurfaceSupport = std::find_if(enabledInstanceExtensions.begin(), enabledInstanceExtensions.end(), [&](auto& e) {
+    return std::string(e) == "VK_KHR_surface";
+  }) != enabledInstanceExtensions.end();
+
   auto instanceCreateInfo = vk::InstanceCreateInfo()
       .setFlags({})
       .setPApplicationInfo(&applicationInfo)
@@ -107,25 +127,16 @@ void DeviceInstance::createVulkanInstance(const std::vector<const char*>& requir
   });
 }
 
-void DeviceInstance::createLogicalDevice(std::vector<vk::QueueFlags> qFlags) {
+void DeviceInstance::createLogicalDevice(std::vector<vk::QueueFlags> qFlags, const std::vector<const char*>& requiredDeviceExtensions) {
 
   std::vector<vk::DeviceQueueCreateInfo> queueInfo;
   auto qFamProps = mPhysicalDevices[0].getQueueFamilyProperties();
   float queuePriorities = 1.f;
-  for( auto& qF : qFlags ) {
-    auto it = std::find_if(qFamProps.begin(), qFamProps.end(), [&](auto& p) {
-      if( p.queueFlags & qF ) return true;
-      throw std::runtime_error("DeviceInstance::createLogicalDevice: Physical device doesn't support requested queue types");
-      return false;
-    });
-    if( it == qFamProps.end() ) continue;
-
-    auto qFamIdx = static_cast<uint32_t>(it - qFamProps.begin());
-
-    auto it2 = std::find_if(queueInfo.begin(), queueInfo.end(), [&](auto& p) {
+  auto addQueueFamily = [&](uint32_t qFamIdx) {
+    auto it = std::find_if(queueInfo.begin(), queueInfo.end(), [&](auto& p) {
       return p.queueFamilyIndex == qFamIdx;
     });
-    if( it2 != queueInfo.end() ) continue;
+    if( it != queueInfo.end() ) return;
 
     auto qInfo = vk::DeviceQueueCreateInfo()
         .setFlags({})
@@ -133,18 +144,43 @@ void DeviceInstance::createLogicalDevice(std::vector<vk::QueueFlags> qFlags) {
         .setQueueCount(1)
         .setPQueuePriorities(&queuePriorities);
     queueInfo.emplace_back(qInfo);
+  };
+
+  for( auto& qF : qFlags ) {
+    auto it = std::find_if(qFamProps.begin(), qFamProps.end(), [&](auto& p) {
+      return (p.queueFlags & qF) == qF;
+    });
+    if( it == qFamProps.end() ) throw std::runtime_error("DeviceInstance::createLogicalDevice: Physical device doesn't support requested queue types");
+    addQueueFamily(static_cast<uint32_t>(it - qFamProps.begin()));
+  }
+
+  // Dedicated families, if the hardware has them
+  // Transfer only - Usually the DMA engines, copies run alongside rendering
+  // Compute without graphics - Async compute
+  for( auto i = 0u; i < qFamProps.size(); ++i ) {
+    auto flags = qFamProps[i].queueFlags;
+    if( !(flags & vk::QueueFlagBits::eGraphics) && !(flags & vk::QueueFlagBits::eCompute) &&
+         (flags & vk::QueueFlagBits::eTransfer) && mTransferFamily == invalidFamily ) {
+      mTransferFamily = i;
+      addQueueFamily(i);
+    }
+    if( !(flags & vk::QueueFlagBits::eGraphics) && (flags & vk::QueueFlagBits::eCompute) && mComputeFamily == invalidFamily ) {
+      mComputeFamily = i;
+      addQueueFamily(i);
+    }
   }
   //if( queueInfo.size() != qFlags.size() )  throw std::runtime_error("DeviceInstance::createLogicalDevice: Physical device doesn't support requested queue types");
 
   auto supportedExtensions = mPhysicalDevices.front().enumerateDeviceExtensionProperties();
-  std::vector<const char*> enabledDeviceExtensions;
+  std::vector<const char*> enabledDeviceExtensions = requiredDeviceExtensions;
   // Allows the viewport to be flipped, core in vk 1.1
   enabledDeviceExtensions.emplace_back("VK_KHR_maintenance1");
 #if defined(VK_USE_PLATFORM_WIN32_KHR) || defined(VK_USE_PLATFORM_XLIB_KHR) || defined(VK_USE_PLATFORM_LIB_XCB_KHR) || defined(USE_GLFW)
   // If building with UI support we need the swapchain extension - allows presenting images to the window
-  enabledDeviceExtensions.push_back("VK_KHR_swapchain");
-  for( auto& e : enabledDeviceExtensions ) Util::ensureExtension(supportedExtensions, e);
+  // Unless we're running headless, in which case there's nothing to present to
+  if( mSurfaceSupport ) enabledDeviceExtensions.push_back("VK_KHR_swapchain");
 #endif
+  for( auto& e : enabledDeviceExtensions ) Util::ensureExtension(supportedExtensions, e);
 
 std::vector<const char*> enabledLayers;
 //#ifdef DEBUG
@@ -158,12 +194,41 @@ std::vector<const char*> enabledLayers;
 
   // The features we require, we get very little without requesting these
   // As listed page 17
-  // TODO: After creation the enabled features are set in this struct, will want to keep it for later
-  auto deviceRequiredFeatures = vk::PhysicalDeviceFeatures()
+  mEnabledFeatures = vk::PhysicalDeviceFeatures()
       .setMultiDrawIndirect(deviceSupportedFeatures.multiDrawIndirect)
+      .setDrawIndirectFirstInstance(deviceSupportedFeatures.drawIndirectFirstInstance)
       .setTessellationShader(true)
       .setGeometryShader(true);
 
+  // Descriptor indexing (Bindless resources), core in vk 1.2
+  // Only the subset needed for large, partially bound, update-after-bind arrays of textures
+  // Querying the features requires vk 1.1 (vkGetPhysicalDeviceFeatures2)
+  auto indexingExtension = "VK_EXT_descriptor_indexing";
+  auto deviceApiVersion = mPhysicalDevices.front().getProperties().apiVersion;
+  if( mApiVersion >= VK_API_VERSION_1_1 && deviceApiVersion >= VK_API_VERSION_1_1 &&
+      std::find_if(supportedExtensions.begin(), supportedExtensions.end(), [&](auto& e) {
+        return std::string(indexingExtension) == e.extensionName;
+      }) != supportedExtensions.end() ) {
+    auto features = mPhysicalDevices.front().getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+    auto& supported = features.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+    if( supported.runtimeDescriptorArray &&
+        supported.descriptorBindingPartiallyBound &&
+        supported.descriptorBindingVariableDescriptorCount &&
+        supported.descriptorBindingSampledImageUpdateAfterBind &&
+        supported.descriptorBindingUpdateUnusedWhilePending &&
+        supported.shaderSampledImageArrayNonUniformIndexing ) {
+      mDescriptorIndexingFeatures = vk::PhysicalDeviceDescriptorIndexingFeaturesEXT()
+          .setRuntimeDescriptorArray(true)
+          .setDescriptorBindingPartiallyBound(true)
+          .setDescriptorBindingVariableDescriptorCount(true)
+          .setDescriptorBindingSampledImageUpdateAfterBind(true)
+          .setDescriptorBindingUpdateUnusedWhilePending(true)
+          .setShaderSampledImageArrayNonUniformIndexing(true);
+      mDescriptorIndexing = true;
+      enabledDeviceExtensions.emplace_back(indexingExtension);
+    }
+  }
+
   auto info = vk::DeviceCreateInfo()
       .setFlags({})
       .setQueueCreateInfoCount(queueInfo.size())
@@ -172,7 +237,8 @@ std::vector<const char*> enabledLayers;
       .setPpEnabledLayerNames(enabledLayers.data())
       .setEnabledExtensionCount(static_cast<uint32_t>(enabledDeviceExtensions.size()))
       .setPpEnabledExtensionNames(enabledDeviceExtensions.data())
-      .setPEnabledFeatures(&deviceRequiredFeatures)
+      .setPEnabledFeatures(&mEnabledFeatures)
+      .setPNext(mDescriptorIndexing ? &mDescriptorIndexingFeatures : nullptr)
       ;
 
   mDevice = mPhysicalDevices.front().createDeviceUnique(info);
@@ -197,10 +263,105 @@ DeviceInstance::QueueRef* DeviceInstance::getQueue( vk::QueueFlags flags ) {
   return &(*it);
 }
 
+DeviceInstance::QueueRef* DeviceInstance::getQueueForFamily( uint32_t famIndex ) {
+  auto it = std::find_if(mQueues.begin(), mQueues.end(), [&]( auto& q) {
+    return q.famIndex == famIndex;
+  });
+  if( it == mQueues.end() ) return nullptr;
+  return &(*it);
+}
+
+DeviceInstance::QueueRef* DeviceInstance::transferQueue() {
+  if( mTransferFamily == invalidFamily ) return nullptr;
+  return getQueueForFamily(mTransferFamily);
+}
+
+DeviceInstance::QueueRef* DeviceInstance::asyncComputeQueue() {
+  if( mComputeFamily == invalidFamily ) return nullptr;
+  return getQueueForFamily(mComputeFamily);
+}
+
 void DeviceInstance::waitAllDevicesIdle() {
   mDevice->waitIdle();
 }
 
+std::string DeviceInstance::pipelineCacheFileName() {
+  auto props = mPhysicalDevices.front().getProperties();
+  std::stringstream name;
+  name << "pipelinecache-" << std::hex << std::setfill('0')
+       << std::setw(4) << props.vendorID << "-"
+       << std::setw(4) << props.deviceID << "-";
+  for( auto b : props.pipelineCacheUUID ) name << std::setw(2) << static_cast<uint32_t>(b);
+  name << ".bin";
+  return name.str();
+}
+
+bool DeviceInstance::pipelineCacheCompatible(const std::vector<char>& data) {
+  // Drivers should reject incompatible data themselves, but not all of them do
+  // Header is: length, version, vendorID, deviceID (uint32), pipelineCacheUUID
+  const auto headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+  if( data.size() < headerSize ) return false;
+
+  uint32_t header[4];
+  std::memcpy(header, data.data(), sizeof(header));
+  auto props = mPhysicalDevices.front().getProperties();
+  if( header[0] < headerSize ) return false;
+  if( header[1] != static_cast<uint32_t>(VK_PIPELINE_CACHE_HEADER_VERSION_ONE) ) return false;
+  if( header[2] != props.vendorID || header[3] != props.deviceID ) return false;
+  return std::memcmp(data.data() + sizeof(header), &props.pipelineCacheUUID[0], VK_UUID_SIZE) == 0;
+}
+
+bool DeviceInstance::loadPipelineCache(const std::string& directory) {
+  mPipelineCachePath = (std::filesystem::path(directory) / pipelineCacheFileName()).string();
+  mPipelineCacheWarm = false;
+
+  // A missing or stale cache isn't an error, we just start cold
+  std::vector<char> data;
+  if( std::filesystem::exists(mPipelineCachePath) ) {
+    try {
+      data = Util::readFile(mPipelineCachePath);
+    } catch( std::exception& e ) {
+      std::cerr << "DeviceInstance::loadPipelineCache: " << e.what() << std::endl;
+    }
+    if( !data.empty() && !pipelineCacheCompatible(data) ) {
+      std::cerr << "DeviceInstance::loadPipelineCache: Ignoring incompatible cache: " << mPipelineCachePath << std::endl;
+      data.clear();
+    }
+  }
+
+  auto info = vk::PipelineCacheCreateInfo()
+    .setInitialDataSize(data.size())
+    .setPInitialData(data.empty() ? nullptr : data.data());
+  mPipelineCache = mDevice->createPipelineCacheUnique(info);
+  mPipelineCacheWarm = !data.empty();
+  return mPipelineCacheWarm;
+}
+
+void DeviceInstance::savePipelineCache() {
+  if( mPipelineCachePath.empty() || !mPipelineCache ) return;
+
+  auto data = mDevice->getPipelineCacheData(mPipelineCache.get());
+  if( data.empty() ) return;
+
+  // Written to a temporary file first, so an interrupted write can't leave a truncated cache
+  auto tmpPath = mPipelineCachePath + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if( !file.is_open() ) {
+      std::cerr << "DeviceInstance::savePipelineCache: Failed to open file: " << tmpPath << std::endl;
+      return;
+    }
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if( !file ) {
+      std::cerr << "DeviceInstance::savePipelineCache: Failed to write file: " << tmpPath << std::endl;
+      return;
+    }
+  }
+  std::error_code err;
+  std::filesystem::rename(tmpPath, mPipelineCachePath, err);
+  if( err ) std::cerr << "DeviceInstance::savePipelineCache: Failed to write cache: " << err.message() << std::endl;
+}
+
 
 vk::UniqueCommandPool DeviceInstance::createCommandPool( vk::CommandPoolCreateFlags flags, DeviceInstance::QueueRef& queue ) {
   auto info = vk::CommandPoolCreateInfo()
@@ -306,6 +467,21 @@ uint32_t DeviceInstance::selectDeviceMemoryHeap( vk::MemoryRequirements memoryRe
   throw std::runtime_error("Failed to find suitable heap type for flags: " + vk::to_string(requiredFlags));
 }
 
+bool DeviceInstance::isUnifiedMemory() {
+  auto deviceType = mPhysicalDevices.front().getProperties().deviceType;
+  if( deviceType == vk::PhysicalDeviceType::eIntegratedGpu ||
+      deviceType == vk::PhysicalDeviceType::eCpu ) return true;
+
+  // Otherwise only if all device local memory is host visible
+  vk::PhysicalDeviceMemoryProperties memoryProperties = mPhysicalDevices.front().getMemoryProperties();
+  for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+    auto flags = memoryProperties.memoryTypes[i].propertyFlags;
+    if( (flags & vk::MemoryPropertyFlagBits::eDeviceLocal) &&
+       !(flags & vk::MemoryPropertyFlagBits::eHostVisible) ) return false;
+  }
+  return true;
+}
+
 /// Allocate device memory suitable for the specified buffer
 vk::UniqueDeviceMemory DeviceInstance::allocateDeviceMemoryForBuffer( vk::Buffer& buffer, vk::MemoryPropertyFlags userReqs ) {
   // Find out what kind of memory the buffer needs
@@ -10,8 +10,12 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <memory>
+#include <string>
 #include <vector>
 
+class DeviceAllocator;
+
 /**
  * Base instance/device information for the application
  * - The vulkan instance
@@ -61,9 +65,68 @@ public:
    */
   DeviceInstance::QueueRef* getQueue( vk::QueueFlags flags );
 
+  /**
+   * A queue from a transfer-only family
+   * @return nullptr if the hardware doesn't have a dedicated transfer family
+   */
+  DeviceInstance::QueueRef* transferQueue();
+
+  /**
+   * A queue from a compute family without graphics support
+   * @return nullptr if the hardware doesn't have a dedicated compute family
+   */
+  DeviceInstance::QueueRef* asyncComputeQueue();
+
+  /// Sub-allocator for device memory, used by SimpleBuffer/SimpleImage
+  DeviceAllocator& allocator() { return *mAllocator; }
+
+  /**
+   * Whether the device's local memory is directly accessible by the host
+   * (Integrated GPUs and similar). If so there's no benefit to staging uploads
+   */
+  bool isUnifiedMemory();
+
+  /// The features enabled on the logical device
+  const vk::PhysicalDeviceFeatures& enabledFeatures() const { return mEnabledFeatures; }
+
+  /**
+   * Whether VK_EXT_descriptor_indexing is enabled, allowing bindless resources
+   * If so runtime sized, partially bound, update-after-bind arrays of sampled images are supported
+   * (See descriptorIndexingFeatures for exactly which features are enabled)
+   */
+  bool descriptorIndexing() const { return mDescriptorIndexing; }
+  const vk::PhysicalDeviceDescriptorIndexingFeaturesEXT& descriptorIndexingFeatures() const { return mDescriptorIndexingFeatures; }
+
+  /// Whether the instance was created with surface support (false if headless)
+  bool surfaceSupport() const { return mSurfaceSupport; }
+
   /// Wait until all physical devices are idle
   void waitAllDevicesIdle();
 
+  /**
+   * Pipeline cache, used when building all pipelines
+   * Created empty, unless loadPipelineCache has been called
+   */
+  vk::PipelineCache& pipelineCache() { return mPipelineCache.get(); }
+
+  /**
+   * Replace the pipeline cache with one loaded from disk
+   * The file is named for the device's vendor/device ID and pipeline cache UUID,
+   * so a driver update or different GPU starts from an empty cache.
+   * Must be called before any pipelines are built
+   * @param directory Directory containing the cache file, also used by savePipelineCache
+   * @return true if existing data was loaded (A warm start)
+   */
+  bool loadPipelineCache(const std::string& directory);
+  /// Write the pipeline cache to disk, if loadPipelineCache was called
+  void savePipelineCache();
+  /// Whether the pipeline cache was populated from disk
+  bool pipelineCacheWarm() const { return mPipelineCacheWarm; }
+
+  /// Total time spent in pipeline creation (ms), see Pipeline::build
+  double pipelineBuildTime() const { return mPipelineBuildTime; }
+  void addPipelineBuildTime(double ms) { mPipelineBuildTime += ms; }
+
 
   // Buffer/etc creation functions
   vk::UniqueCommandPool createCommandPool( vk::CommandPoolCreateFlags flags, DeviceInstance::QueueRef& queue );
@@ -105,7 +168,11 @@ public:
 
 private:
   void createVulkanInstance(const std::vector<const char*>& requiredExtensions, std::string appName, uint32_t appVer, uint32_t apiVer, const std::vector<const char*>& enabledLayers);
-  void createLogicalDevice(std::vector<vk::QueueFlags> qFlags);
+  void createLogicalDevice(std::vector<vk::QueueFlags> qFlags, const std::vector<const char*>& requiredDeviceExtensions);
+  DeviceInstance::QueueRef* getQueueForFamily( uint32_t famIndex );
+  std::string pipelineCacheFileName();
+  /// Check a cache blob was written by this device/driver, see VkPipelineCacheHeaderVersionOne
+  bool pipelineCacheCompatible(const std::vector<char>& data);
 
   std::vector<vk::PhysicalDevice> mPhysicalDevices;
 
@@ -113,6 +180,23 @@ private:
   vk::UniqueDevice mDevice;
 
   std::vector<QueueRef> mQueues;
+  vk::PhysicalDeviceFeatures mEnabledFeatures;
+  vk::PhysicalDeviceDescriptorIndexingFeaturesEXT mDescriptorIndexingFeatures;
+  bool mDescriptorIndexing = false;
+  uint32_t mApiVersion = VK_API_VERSION_1_0;
+
+  static const uint32_t invalidFamily = ~0u;
+  uint32_t mTransferFamily = invalidFamily;
+  uint32_t mComputeFamily = invalidFamily;
+
+  std::unique_ptr<DeviceAllocator> mAllocator;
+
+  vk::UniquePipelineCache mPipelineCache;
+  std::string mPipelineCachePath;
+  bool mPipelineCacheWarm = false;
+  double mPipelineBuildTime = 0.0;
+
+  bool mSurfaceSupport = false;
 };
 
 #endif // DEVICEINSTANCE_H
@@ -0,0 +1,63 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "frameallocator.h"
+
+#include "deviceinstance.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+FrameAllocator::FrameAllocator(DeviceInstance& deviceInstance, vk::DeviceSize capacity, vk::BufferUsageFlags usageFlags,
+                               std::string name)
+  : mDeviceInstance(deviceInstance)
+  , mUsageFlags(usageFlags)
+  , mCapacity(capacity)
+  , mName(std::move(name))
+{
+  createBuffer();
+}
+
+FrameAllocator::~FrameAllocator() {
+  mData = nullptr;
+  mBuffer.reset();
+}
+
+void FrameAllocator::createBuffer() {
+  mBuffer.reset(new SimpleBuffer(mDeviceInstance, mCapacity, mUsageFlags));
+  mBuffer->name() = mName;
+  mData = static_cast<uint8_t*>(mBuffer->map());
+}
+
+bool FrameAllocator::reset(vk::DeviceSize capacity) {
+  mHead = 0;
+  if( capacity <= mCapacity ) return false;
+
+  // Grow geometrically, so a slowly growing scene doesn't replace the buffer every frame
+  mCapacity = std::max(capacity, mCapacity * 2);
+  mBuffer.reset();
+  createBuffer();
+  return true;
+}
+
+FrameAllocator::Range FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+  alignment = std::max(alignment, vk::DeviceSize(1));
+  auto start = ((mHead + alignment - 1) / alignment) * alignment;
+  if( start + size > mCapacity ) throw std::runtime_error("FrameAllocator::allocate: Out of space, reserve more in reset");
+  mHead = start + size;
+
+  Range result;
+  result.offset = start;
+  result.size = size;
+  result.data = mData + start;
+  return result;
+}
+
+void FrameAllocator::flush(const Range& range, vk::DeviceSize offset, vk::DeviceSize size) {
+  if( size == VK_WHOLE_SIZE ) size = range.size - offset;
+  mBuffer->flush(range.offset + offset, size);
+}
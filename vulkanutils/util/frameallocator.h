@@ -0,0 +1,79 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef FRAMEALLOCATOR_H
+#define FRAMEALLOCATOR_H
+
+#include <vulkan/vulkan.hpp>
+
+#include "simplebuffer.h"
+
+#include <memory>
+#include <string>
+
+class DeviceInstance;
+
+/**
+ * Linear allocator for transient per-frame data (Uniforms, instance data, indirect commands)
+ * - A single host visible buffer, mapped for its lifetime
+ * - Allocations are bumped from the start of the buffer, and freed all at once by reset
+ *   once the gpu has finished with the frame (Its fence has signalled)
+ * - Intended to be bound through dynamic offsets, so one descriptor set covers
+ *   every allocation and new data doesn't need its own buffer/descriptor
+ *
+ * The buffer is only replaced by reset, so allocations remain valid until the next reset.
+ */
+class FrameAllocator
+{
+public:
+  /// A sub-range of the buffer
+  struct Range {
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    /// Host pointer to the start of the range
+    void* data = nullptr;
+  };
+
+  /// @param name Name of the buffer, kept when it's replaced
+  FrameAllocator(DeviceInstance& deviceInstance, vk::DeviceSize capacity, vk::BufferUsageFlags usageFlags,
+                 std::string name = "FrameAllocator");
+  ~FrameAllocator();
+
+  /**
+   * Free all allocations, the gpu must have finished with them
+   * @param capacity Size needed for the next frame, the buffer is replaced if it's smaller
+   * @return true if the buffer was replaced, descriptors referencing it must be updated
+   */
+  bool reset(vk::DeviceSize capacity = 0);
+
+  /// Allocate size bytes, throws if the buffer is full
+  Range allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+  /// Flush host writes to a range, offset/size are relative to the range
+  void flush(const Range& range, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+
+  SimpleBuffer& buffer() { return *mBuffer.get(); }
+  vk::DeviceSize capacity() const { return mCapacity; }
+  /// Bytes allocated since the last reset
+  vk::DeviceSize used() const { return mHead; }
+
+private:
+  FrameAllocator(const FrameAllocator&) = delete;
+  FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+  void createBuffer();
+
+  DeviceInstance& mDeviceInstance;
+  vk::BufferUsageFlags mUsageFlags;
+  vk::DeviceSize mCapacity = 0;
+  vk::DeviceSize mHead = 0;
+  std::unique_ptr<SimpleBuffer> mBuffer;
+  uint8_t* mData = nullptr;
+  std::string mName;
+};
+
+#endif
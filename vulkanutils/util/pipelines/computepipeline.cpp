@@ -51,5 +51,5 @@ void ComputePipeline::createPipeline() {
       .setBasePipelineIndex(-1)
       ;
 
-  mPipeline = mDeviceInstance.device().createComputePipelineUnique({}, pipelineInfo);
+  mPipeline = mDeviceInstance.device().createComputePipelineUnique(mDeviceInstance.pipelineCache(), pipelineInfo);
 }
@@ -53,7 +53,8 @@ void GraphicsPipeline::createRenderPass() {
       .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
       .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
       .setInitialLayout(vk::ImageLayout::eUndefined)
-      .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+      // Ready for presentation, or if headless ready to be copied somewhere else
+      .setFinalLayout(mWindowIntegration.headless() ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR);
 
   // For starters we only need one sub-pass to draw
   // Multiple sub passes are used for multi-pass rendering
@@ -150,20 +151,15 @@ void GraphicsPipeline::createPipeline() {
       ;
 
   // Viewport
-  // TODO: This should be set as dynamic state, passed through in the render pass
-  vk::Viewport viewport(0.f,0.f, mWindowIntegration.swapChainExtent().width, mWindowIntegration.swapChainExtent().height, 0.f, 1.f);
-  if( mInvertY ) {
-      // Flip the viewport
-      viewport.height = - static_cast<float>(mWindowIntegration.swapChainExtent().height);
-      viewport.y = static_cast<float>(mWindowIntegration.swapChainExtent().height);
-  }
+  // If dynamic the viewport/scissor are set while recording, only the counts are needed here
+  auto viewport = viewportForExtent(mWindowIntegration.swapChainExtent());
   vk::Rect2D scissor({0,0},mWindowIntegration.swapChainExtent());
   auto viewportInfo = vk::PipelineViewportStateCreateInfo()
       .setFlags({})
       .setViewportCount(1)
-      .setPViewports(&viewport)
+      .setPViewports(mDynamicViewport ? nullptr : &viewport)
       .setScissorCount(1)
-      .setPScissors(&scissor)
+      .setPScissors(mDynamicViewport ? nullptr : &scissor)
       ;
 
   // Rasteriser
@@ -220,7 +216,12 @@ void GraphicsPipeline::createPipeline() {
   // Dynamic state
   // There's a dynamic state section that allows setting things like viewport/etc without rebuilding
   // the entire pipeline
-  // If this is provided then the state has to be provided at draw time, so for now it's just another nullptr
+  // If this is provided then the state has to be provided at draw time
+  vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+  auto dynamicInfo = vk::PipelineDynamicStateCreateInfo()
+      .setDynamicStateCount(2)
+      .setPDynamicStates(dynamicStates)
+      ;
 
   // Pipeline layout
   // Pipeline layout is where uniforms and such go
@@ -251,7 +252,7 @@ void GraphicsPipeline::createPipeline() {
       .setPMultisampleState(&multisampleInfo)
       .setPDepthStencilState(&depthStencil)
       .setPColorBlendState(&colourBlendInfo)
-      .setPDynamicState(nullptr)
+      .setPDynamicState(mDynamicViewport ? &dynamicInfo : nullptr)
       .setLayout(mPipelineLayout.get())
       .setRenderPass(mRenderPass.get()) // The render pass the pipeline will be used in
       .setSubpass(0) // The sub pass the pipeline will be used in
@@ -260,9 +261,24 @@ void GraphicsPipeline::createPipeline() {
       ;
 
 
-  mPipeline = mDeviceInstance.device().createGraphicsPipelineUnique({}, pipelineInfo);
+  mPipeline = mDeviceInstance.device().createGraphicsPipelineUnique(mDeviceInstance.pipelineCache(), pipelineInfo);
   if( !mPipeline ) throw std::runtime_error("Failed to create pipeline");
   // Shader modules deleted here, only needed for pipeline init
 }
 
+vk::Viewport GraphicsPipeline::viewportForExtent(vk::Extent2D extent) const {
+  vk::Viewport viewport(0.f,0.f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.f, 1.f);
+  if( mInvertY ) {
+      // Flip the viewport
+      viewport.height = - static_cast<float>(extent.height);
+      viewport.y = static_cast<float>(extent.height);
+  }
+  return viewport;
+}
 
+void GraphicsPipeline::setViewport(vk::CommandBuffer& commandBuffer, vk::Extent2D extent) const {
+  auto viewport = viewportForExtent(extent);
+  vk::Rect2D scissor({0,0}, extent);
+  commandBuffer.setViewport(0, 1, &viewport);
+  commandBuffer.setScissor(0, 1, &scissor);
+}
@@ -34,8 +34,18 @@ public:
 
   void inputAssembly_primitiveTopology(vk::PrimitiveTopology top) { mInputAssemblyPrimitiveTopology = top; }
 
+  /**
+   * Whether the viewport and scissor are dynamic state
+   * If so they must be set with setViewport when recording, and the pipeline
+   * doesn't need rebuilding when the swapchain is resized
+   */
+  void dynamicViewport(bool enable) { mDynamicViewport = enable; }
+  /// Record a viewport and scissor covering extent, flipped if invertY
+  void setViewport(vk::CommandBuffer& commandBuffer, vk::Extent2D extent) const;
+
 private:
   void createRenderPass();
+  vk::Viewport viewportForExtent(vk::Extent2D extent) const;
   void createPipeline() final override;
 
   WindowIntegration& mWindowIntegration;
@@ -50,6 +60,7 @@ private:
 
   // Whether to flip y axis (follow opengl conventions) or not (follow vulkan conventions)
   bool mInvertY = false;
+  bool mDynamicViewport = false;
 
   vk::SampleCountFlagBits mSamples = vk::SampleCountFlagBits::e1;
 };
@@ -11,6 +11,7 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <chrono>
 #include <map>
 
 Pipeline::Pipeline(DeviceInstance& deviceInstance)
@@ -20,7 +21,11 @@ Pipeline::Pipeline(DeviceInstance& deviceInstance)
 
 vk::Pipeline& Pipeline::build() {
   createDescriptorSetLayouts();
+  // Timed to compare cold/warm pipeline cache starts
+  auto start = std::chrono::steady_clock::now();
   createPipeline();
+  auto end = std::chrono::steady_clock::now();
+  mDeviceInstance.addPipelineBuildTime(std::chrono::duration<double, std::milli>(end - start).count());
   return mPipeline.get();
 }
 
@@ -37,21 +42,47 @@ vk::UniqueShaderModule Pipeline::createShaderModule(const std::string& fileName)
   return mDeviceInstance.device().createShaderModuleUnique(info);
 }
 
-void Pipeline::addDescriptorSetLayoutBinding( uint32_t layoutIndex, uint32_t binding, vk::DescriptorType type, uint32_t count, vk::ShaderStageFlags stageFlags) {
+vk::UniqueShaderModule Pipeline::createShaderModule(std::span<const uint32_t> code) {
+  auto info = vk::ShaderModuleCreateInfo()
+      .setFlags({})
+      .setCodeSize(code.size_bytes())
+      .setPCode(code.data())
+      ;
+  return mDeviceInstance.device().createShaderModuleUnique(info);
+}
+
+void Pipeline::addDescriptorSetLayoutBinding( uint32_t layoutIndex, uint32_t binding, vk::DescriptorType type, uint32_t count, vk::ShaderStageFlags stageFlags, vk::DescriptorBindingFlagsEXT bindingFlags) {
   auto dslBinding = vk::DescriptorSetLayoutBinding()
       .setBinding(binding)
       .setDescriptorType(type)
       .setDescriptorCount(count)
       .setStageFlags(stageFlags);
-  if( mDescriptorSetLayoutBindings.size() <= layoutIndex ) mDescriptorSetLayoutBindings.resize(layoutIndex + 1);
+  if( mDescriptorSetLayoutBindings.size() <= layoutIndex ) {
+    mDescriptorSetLayoutBindings.resize(layoutIndex + 1);
+    mDescriptorSetLayoutBindingFlags.resize(layoutIndex + 1);
+  }
   mDescriptorSetLayoutBindings[layoutIndex].emplace_back(dslBinding);
+  mDescriptorSetLayoutBindingFlags[layoutIndex].emplace_back(bindingFlags);
 }
 
 void Pipeline::createDescriptorSetLayouts() {
-  for( auto& dslB : mDescriptorSetLayoutBindings ) {
+  for( auto i = 0u; i < mDescriptorSetLayoutBindings.size(); ++i ) {
+    auto& dslB = mDescriptorSetLayoutBindings[i];
+    auto& dslFlags = mDescriptorSetLayoutBindingFlags[i];
     auto createInfo = vk::DescriptorSetLayoutCreateInfo()
         .setBindingCount(dslB.size())
         .setPBindings(dslB.data());
+
+    // Binding flags are only passed if used, so layouts don't require descriptor indexing otherwise
+    auto flagsInfo = vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT()
+        .setBindingCount(dslFlags.size())
+        .setPBindingFlags(dslFlags.data());
+    auto anyFlags = vk::DescriptorBindingFlagsEXT();
+    for( auto& f : dslFlags ) anyFlags |= f;
+    if( anyFlags ) createInfo.setPNext(&flagsInfo);
+    if( anyFlags & vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind ) {
+      createInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT);
+    }
     mDescriptorSetLayouts.emplace_back(mDeviceInstance.device().createDescriptorSetLayoutUnique(createInfo));
   }
 }
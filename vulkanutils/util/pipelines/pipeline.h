@@ -12,6 +12,7 @@
 
 #include <vector>
 #include <map>
+#include <span>
 
 class DeviceInstance;
 
@@ -42,6 +43,8 @@ public:
    * have been initialised.
    */
   vk::UniqueShaderModule createShaderModule(const std::string& fileName);
+  /// Build a shader module from SPIR-V in memory, such as shaders embedded in the binary
+  vk::UniqueShaderModule createShaderModule(std::span<const uint32_t> code);
 
   std::map<vk::ShaderStageFlagBits, vk::UniqueShaderModule>& shaders() { return mShaders; }
 
@@ -59,8 +62,10 @@ public:
    * @param type Type of descriptor (sampler, uniform buffer, etc)
    * @param count Number of descriptors
    * @param stageFlags Shader stage flags (likely vk::ShaderStageFlagBits::eCompute)
+   * @param bindingFlags Descriptor indexing flags (Requires VK_EXT_descriptor_indexing). If any binding
+   *                     of a layout is update-after-bind the layout is created for update-after-bind pools
    */
-  void addDescriptorSetLayoutBinding( uint32_t layoutIndex, uint32_t binding, vk::DescriptorType type, uint32_t count, vk::ShaderStageFlags stageFlags);
+  void addDescriptorSetLayoutBinding( uint32_t layoutIndex, uint32_t binding, vk::DescriptorType type, uint32_t count, vk::ShaderStageFlags stageFlags, vk::DescriptorBindingFlagsEXT bindingFlags = {});
   const std::vector<vk::UniqueDescriptorSetLayout>& descriptorSetLayouts() const { return mDescriptorSetLayouts; }
 
   /// Push Constants
@@ -76,6 +81,8 @@ protected:
   std::map<vk::ShaderStageFlagBits, vk::SpecializationInfo> mSpecialisationConstants;
   /// Layout index, binding info
   std::vector<std::vector<vk::DescriptorSetLayoutBinding>> mDescriptorSetLayoutBindings;
+  /// Layout index, flags of each binding in mDescriptorSetLayoutBindings
+  std::vector<std::vector<vk::DescriptorBindingFlagsEXT>> mDescriptorSetLayoutBindingFlags;
   std::vector<vk::UniqueDescriptorSetLayout> mDescriptorSetLayouts;
 
   std::vector<vk::PushConstantRange> mPushConstants;
@@ -0,0 +1,80 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "rangeallocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+RangeAllocator::RangeAllocator(vk::DeviceSize size)
+  : mSize(size)
+{
+  if( mSize ) mFreeRanges[0] = mSize;
+}
+
+RangeAllocator::~RangeAllocator() {}
+
+vk::DeviceSize RangeAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+  if( size == 0 ) throw std::runtime_error("RangeAllocator::allocate: Zero sized allocation");
+  if( alignment == 0 ) alignment = 1;
+
+  for( auto it = mFreeRanges.begin(); it != mFreeRanges.end(); ++it ) {
+    auto rangeStart = it->first;
+    auto rangeEnd = it->first + it->second;
+    auto alignedStart = ((rangeStart + alignment - 1) / alignment) * alignment;
+    if( alignedStart + size > rangeEnd ) continue;
+
+    // Split the range - Padding before the allocation and the
+    // remainder after it both stay in the free list
+    mFreeRanges.erase(it);
+    if( alignedStart > rangeStart ) mFreeRanges[rangeStart] = alignedStart - rangeStart;
+    if( alignedStart + size < rangeEnd ) mFreeRanges[alignedStart + size] = rangeEnd - (alignedStart + size);
+
+    mUsed += size;
+    return alignedStart;
+  }
+  return invalidOffset;
+}
+
+void RangeAllocator::free(vk::DeviceSize offset, vk::DeviceSize size) {
+  if( offset + size > mSize ) throw std::runtime_error("RangeAllocator::free: Range outside of allocator");
+  mUsed -= size;
+  insertFree(offset, size);
+}
+
+void RangeAllocator::grow(vk::DeviceSize newSize) {
+  if( newSize <= mSize ) return;
+  auto oldSize = mSize;
+  mSize = newSize;
+  insertFree(oldSize, newSize - oldSize);
+}
+
+vk::DeviceSize RangeAllocator::largestFreeRegion() const {
+  vk::DeviceSize largest = 0;
+  for( auto& r : mFreeRanges ) largest = std::max(largest, r.second);
+  return largest;
+}
+
+void RangeAllocator::insertFree(vk::DeviceSize offset, vk::DeviceSize size) {
+  auto it = mFreeRanges.emplace(offset, size).first;
+
+  // Merge with the following range
+  auto next = std::next(it);
+  if( next != mFreeRanges.end() && it->first + it->second == next->first ) {
+    it->second += next->second;
+    mFreeRanges.erase(next);
+  }
+
+  // Merge with the preceding range
+  if( it != mFreeRanges.begin() ) {
+    auto prev = std::prev(it);
+    if( prev->first + prev->second == it->first ) {
+      prev->second += it->second;
+      mFreeRanges.erase(it);
+    }
+  }
+}
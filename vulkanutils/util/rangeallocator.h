@@ -0,0 +1,59 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef RANGEALLOCATOR_H
+#define RANGEALLOCATOR_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <map>
+
+/**
+ * Sub-allocation of ranges within a larger region
+ * - First fit free list, aligned allocations
+ * - Neighbouring free ranges are merged when freed
+ *
+ * Doesn't own any memory itself, just tracks offsets. Used to
+ * split large device memory blocks/buffers into smaller pieces.
+ */
+class RangeAllocator
+{
+public:
+  /// Returned by allocate if there's no space
+  static const vk::DeviceSize invalidOffset = ~vk::DeviceSize(0);
+
+  RangeAllocator(vk::DeviceSize size);
+  ~RangeAllocator();
+
+  /**
+   * Allocate a range
+   * @return offset of the range, or invalidOffset if no space is available
+   */
+  vk::DeviceSize allocate(vk::DeviceSize size, vk::DeviceSize alignment = 1);
+
+  /// Release a range, offset and size must match a previous call to allocate
+  void free(vk::DeviceSize offset, vk::DeviceSize size);
+
+  /// Extend the managed region, new space is appended to the end
+  void grow(vk::DeviceSize newSize);
+
+  vk::DeviceSize size() const { return mSize; }
+  vk::DeviceSize used() const { return mUsed; }
+  bool empty() const { return mUsed == 0; }
+  uint32_t freeRegionCount() const { return static_cast<uint32_t>(mFreeRanges.size()); }
+  vk::DeviceSize largestFreeRegion() const;
+
+private:
+  void insertFree(vk::DeviceSize offset, vk::DeviceSize size);
+
+  vk::DeviceSize mSize = 0;
+  vk::DeviceSize mUsed = 0;
+  /// offset, size - ordered by offset so neighbours can be merged
+  std::map<vk::DeviceSize, vk::DeviceSize> mFreeRanges;
+};
+
+#endif
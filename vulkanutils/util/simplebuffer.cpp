@@ -20,8 +20,9 @@ SimpleBuffer::SimpleBuffer(
   , mMemoryPropertyFlags(memFlags)
 {
   mBuffer =  mDeviceInstance.createBuffer(mSize, mBufferUsageFlags);
-  mDeviceMemory =  mDeviceInstance.allocateDeviceMemoryForBuffer(mBuffer.get(), mMemoryPropertyFlags);
-  mDeviceInstance.bindMemoryToBuffer(mBuffer.get(), mDeviceMemory.get(), 0);
+  auto memReq = mDeviceInstance.device().getBufferMemoryRequirements(mBuffer.get());
+  mAllocation = mDeviceInstance.allocator().allocate(memReq, mMemoryPropertyFlags, true);
+  mDeviceInstance.bindMemoryToBuffer(mBuffer.get(), mAllocation.memory, mAllocation.offset);
 }
 
 SimpleBuffer::~SimpleBuffer() {
@@ -29,23 +30,23 @@ SimpleBuffer::~SimpleBuffer() {
     flush();
     unmap();
   }
+  mBuffer.reset();
+  mDeviceInstance.allocator().free(mAllocation);
 }
 
 void* SimpleBuffer::map() {
-  if( mMapped ) return nullptr;
-  auto res = mDeviceInstance.mapMemory(mDeviceMemory.get(), 0, VK_WHOLE_SIZE);
+  // Host visible blocks are persistently mapped by the allocator
+  if( !mAllocation.mapped ) throw std::runtime_error("SimpleBuffer::map: Buffer memory isn't host visible");
   mMapped = true;
-  return res;
+  return mAllocation.mapped;
 }
 
 void SimpleBuffer::unmap() {
-  if( !mMapped ) return;
-   mDeviceInstance.unmapMemory(mDeviceMemory.get());
-   mMapped = false;
+  mMapped = false;
 }
 
-void SimpleBuffer::flush() {
-   mDeviceInstance.flushMemoryRanges({vk::MappedMemoryRange(mDeviceMemory.get(), 0, VK_WHOLE_SIZE)});
+void SimpleBuffer::flush(vk::DeviceSize offset, vk::DeviceSize size) {
+  mDeviceInstance.allocator().flush(mAllocation, offset, size);
 }
 
 std::string& SimpleBuffer::name() { return mName; }
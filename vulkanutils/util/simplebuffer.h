@@ -11,16 +11,14 @@
 #include <vulkan/vulkan.hpp>
 #include <string>
 
+#include "deviceallocator.h"
+
 class DeviceInstance;
 
 /**
  * A very simple class for managing buffers
  * - One buffer for each piece of data
- * - Absolutely nothing else
- *
- * This really won't scale as we'll hit the allocation limit
- * at some point
- * But for now let's just roll with it as a starting point
+ * - Memory is sub-allocated from the DeviceInstance's allocator
  */
 class SimpleBuffer
 {
@@ -28,7 +26,6 @@ public:
   /**
    * Allocate a buffer
    * Memory will be immediately allocated and bound to the buffer
-   * Each buffer will have a separate memory allocation
    */
   SimpleBuffer(
       DeviceInstance& deviceInstance,
@@ -37,12 +34,27 @@ public:
       vk::MemoryPropertyFlags memFlags = {vk::MemoryPropertyFlagBits::eHostVisible});
   ~SimpleBuffer();
 
+  /**
+   * Map the buffer for host access
+   * Host visible memory is persistently mapped by the allocator, so the pointer remains
+   * valid until the buffer is destroyed. A buffer may stay mapped for its whole lifetime,
+   * calling map again returns the same pointer
+   */
   void* map();
   void unmap();
-  void flush();
+  /**
+   * Make host writes visible to the device
+   * offset/size are relative to the buffer, only the written range needs to be flushed
+   * No-op if the memory is host coherent
+   */
+  void flush(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+  /// Whether host writes are visible to the device without a flush
+  bool hostCoherent() const { return static_cast<bool>(mAllocation.memoryFlags & vk::MemoryPropertyFlagBits::eHostCoherent); }
 
   vk::Buffer& buffer();
   vk::DeviceSize size() const { return mSize; }
+  /// Properties of the memory the buffer was placed in (May be more than requested)
+  vk::MemoryPropertyFlags memoryFlags() const { return mAllocation.memoryFlags; }
 
   /// The name of the buffer - Handy if you're trying to work out which one you forgot to delete ;)
   std::string& name();
@@ -52,7 +64,7 @@ private:
 
   DeviceInstance& mDeviceInstance;
   vk::UniqueBuffer mBuffer;
-  vk::UniqueDeviceMemory mDeviceMemory;
+  DeviceAllocator::Allocation mAllocation;
   vk::DeviceSize mSize;
   vk::BufferUsageFlags mBufferUsageFlags;
   vk::MemoryPropertyFlags mMemoryPropertyFlags;
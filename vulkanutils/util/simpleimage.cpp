@@ -41,9 +41,10 @@ SimpleImage::SimpleImage(DeviceInstance& deviceInstance,
   );
 
   // Setup the image's memory
-  mDeviceMemory = mDeviceInstance.allocateDeviceMemoryForImage(mImage, memFlags);
-  if( !mDeviceMemory ) throw std::runtime_error("SimpleImage: Failed to allocate memory");
-  mDeviceInstance.bindMemoryToImage(mImage, mDeviceMemory, 0);
+  auto memReq = mDeviceInstance.device().getImageMemoryRequirements(mImage.get());
+  mAllocation = mDeviceInstance.allocator().allocate(memReq, memFlags, false);
+  if( !mAllocation ) throw std::runtime_error("SimpleImage: Failed to allocate memory");
+  mDeviceInstance.device().bindImageMemory(mImage.get(), mAllocation.memory, mAllocation.offset);
 
   // TODO: For now just making one view, same format as the image itself
   mImageView = mDeviceInstance.createImageView(
@@ -61,23 +62,25 @@ SimpleImage::~SimpleImage() {
     flush();
     unmap();
   }
+  mImageView.reset();
+  mImage.reset();
+  mDeviceInstance.allocator().free(mAllocation);
 }
 
 void* SimpleImage::map() {
   if( mMapped ) return nullptr;
-  auto res = mDeviceInstance.mapMemory(mDeviceMemory.get(), 0, VK_WHOLE_SIZE);
+  // Host visible blocks are persistently mapped by the allocator
+  if( !mAllocation.mapped ) throw std::runtime_error("SimpleImage::map: Image memory isn't host visible");
   mMapped = true;
-  return res;
+  return mAllocation.mapped;
 }
 
 void SimpleImage::unmap() {
-  if( !mMapped ) return;
-   mDeviceInstance.unmapMemory(mDeviceMemory.get());
-   mMapped = false;
+  mMapped = false;
 }
 
 void SimpleImage::flush() {
-   mDeviceInstance.flushMemoryRanges({vk::MappedMemoryRange(mDeviceMemory.get(), 0, VK_WHOLE_SIZE)});
+  mDeviceInstance.allocator().flush(mAllocation);
 }
 
 std::string& SimpleImage::name() { return mName; }
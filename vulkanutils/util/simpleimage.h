@@ -11,6 +11,8 @@
 #include <vulkan/vulkan.hpp>
 #include <string>
 
+#include "deviceallocator.h"
+
 class DeviceInstance;
 
 /**
@@ -57,7 +59,7 @@ private:
   vk::UniqueImage mImage;
   vk::UniqueImageView mImageView;
 
-  vk::UniqueDeviceMemory mDeviceMemory;
+  DeviceAllocator::Allocation mAllocation;
 
   vk::Format mFormat;
 
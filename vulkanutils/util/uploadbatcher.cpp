@@ -0,0 +1,345 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#include "uploadbatcher.h"
+
+#include "simplebuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+
+UploadBatcher::UploadBatcher(DeviceInstance& deviceInstance, DeviceInstance::QueueRef& queue, DeviceInstance::QueueRef* ownerQueue, vk::DeviceSize stagingSize)
+  : mDeviceInstance(deviceInstance)
+  , mQueue(queue)
+  , mOwnerQueue(ownerQueue)
+  , mStagingSize(stagingSize)
+{
+  mCommandPool = mDeviceInstance.createCommandPool({ vk::CommandPoolCreateFlagBits::eTransient }, mQueue);
+  if( mOwnerQueue && mOwnerQueue->famIndex != mQueue.famIndex ) {
+    mAcquireCommandPool = mDeviceInstance.createCommandPool({ vk::CommandPoolCreateFlagBits::eTransient }, *mOwnerQueue);
+  }
+  mStaging.reset(new SimpleBuffer(mDeviceInstance, mStagingSize, vk::BufferUsageFlagBits::eTransferSrc));
+  mStaging->name() = "UploadBatcher::staging";
+  // Left mapped for the lifetime of the batcher
+  mStagingData = static_cast<uint8_t*>(mStaging->map());
+}
+
+UploadBatcher::~UploadBatcher() {
+  waitIdle();
+  mInFlight.clear();
+  mStaging->unmap();
+  mStaging.reset();
+  mAcquireCommandPool.reset();
+  mCommandPool.reset();
+}
+
+void UploadBatcher::enqueueBuffer(vk::Buffer dst, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size) {
+  if( size == 0 ) return;
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto src = stage(data, size, 16);
+  BufferCopy copy;
+  copy.src = src.first;
+  copy.dst = dst;
+  copy.region = vk::BufferCopy(src.second, dstOffset, size);
+  mPendingBufferCopies.emplace_back(copy);
+  mPendingCount++;
+}
+
+void UploadBatcher::enqueueBuffer(SimpleBuffer& dst, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset) {
+  enqueueBuffer(dst.buffer(), dstOffset, data, size);
+}
+
+void UploadBatcher::enqueueImage(vk::Image dst, vk::ImageSubresourceLayers subresource, vk::Extent3D extent,
+                                 const void* data, vk::DeviceSize size, vk::ImageLayout finalLayout) {
+  if( size == 0 ) return;
+  std::lock_guard<std::mutex> lock(mMutex);
+  // bufferOffset must be a multiple of 4 and the texel size, 16 covers all the common formats
+  auto src = stage(data, size, 16);
+  ImageCopy copy;
+  copy.src = src.first;
+  copy.dst = dst;
+  copy.region = vk::BufferImageCopy()
+    .setBufferOffset(src.second)
+    .setImageSubresource(subresource)
+    .setImageExtent(extent);
+  copy.finalLayout = finalLayout;
+  mPendingImageCopies.emplace_back(copy);
+  mPendingCount++;
+}
+
+uint64_t UploadBatcher::submit() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  retire();
+  return submitLocked();
+}
+
+bool UploadBatcher::isComplete(uint64_t serial) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  retire();
+  return serial <= mCompletedSerial;
+}
+
+void UploadBatcher::wait(uint64_t serial) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  retire(serial);
+}
+
+void UploadBatcher::waitIdle() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  retire(submitLocked());
+}
+
+vk::DeviceSize UploadBatcher::allocateStaging(vk::DeviceSize size, vk::DeviceSize alignment) {
+  auto start = ((mRingHead + alignment - 1) / alignment) * alignment;
+  // Allocations don't wrap around the end of the ring
+  if( (start % mStagingSize) + size > mStagingSize ) start = ((start / mStagingSize) + 1) * mStagingSize;
+
+  while( start + size - mRingTail > mStagingSize ) {
+    if( mPendingCount ) submitLocked();
+    if( mInFlight.empty() ) {
+      // Nothing is using the ring, start again from here
+      mRingTail = start;
+      break;
+    }
+    retire(mInFlight.front().serial);
+  }
+
+  mRingHead = start + size;
+  return start % mStagingSize;
+}
+
+std::pair<vk::Buffer, vk::DeviceSize> UploadBatcher::stage(const void* data, vk::DeviceSize size, vk::DeviceSize alignment) {
+  if( size > mStagingSize ) {
+    // Too big for the ring, use a separate buffer released with the batch
+    std::unique_ptr<SimpleBuffer> buf(new SimpleBuffer(mDeviceInstance, size, vk::BufferUsageFlagBits::eTransferSrc));
+    buf->name() = "UploadBatcher::dedicatedStaging";
+    std::memcpy(buf->map(), data, size);
+    buf->flush();
+    buf->unmap();
+    auto result = std::make_pair(buf->buffer(), vk::DeviceSize(0));
+    mPendingDedicatedStaging.emplace_back(std::move(buf));
+    return result;
+  }
+
+  auto offset = allocateStaging(size, alignment);
+  std::memcpy(mStagingData + offset, data, size);
+  return {mStaging->buffer(), offset};
+}
+
+uint64_t UploadBatcher::submitLocked() {
+  if( mPendingCount == 0 ) return mNextSerial - 1;
+
+  // Staging writes are flushed once per batch
+  mStaging->flush();
+
+  Batch batch;
+  batch.serial = mNextSerial++;
+
+  auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
+    .setCommandPool(mCommandPool.get())
+    .setCommandBufferCount(1)
+    .setLevel(vk::CommandBufferLevel::ePrimary);
+  batch.commandBuffer = std::move(mDeviceInstance.device().allocateCommandBuffersUnique(commandBufferAllocateInfo).front());
+  auto& cmd = batch.commandBuffer.get();
+
+  cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+  // Transition images to transfer dst, previous contents are discarded
+  std::vector<vk::ImageMemoryBarrier> preBarriers;
+  for( auto& copy : mPendingImageCopies ) {
+    auto& sub = copy.region.imageSubresource;
+    preBarriers.emplace_back(vk::ImageMemoryBarrier()
+      .setSrcAccessMask({})
+      .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+      .setOldLayout(vk::ImageLayout::eUndefined)
+      .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+      .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .setImage(copy.dst)
+      .setSubresourceRange(vk::ImageSubresourceRange(sub.aspectMask, sub.mipLevel, 1, sub.baseArrayLayer, sub.layerCount)));
+  }
+  if( !preBarriers.empty() ) {
+    cmd.pipelineBarrier(
+      vk::PipelineStageFlagBits::eTopOfPipe,
+      vk::PipelineStageFlagBits::eTransfer,
+      {}, 0, nullptr, 0, nullptr, static_cast<uint32_t>(preBarriers.size()), preBarriers.data());
+  }
+
+  recordBufferCopies(cmd);
+  for( auto& copy : mPendingImageCopies ) {
+    cmd.copyBufferToImage(copy.src, copy.dst, vk::ImageLayout::eTransferDstOptimal, 1, &copy.region);
+  }
+
+  // If the data is consumed by another queue family ownership of the written
+  // ranges is released here, and acquired on the owner queue once the copies complete
+  auto ownershipTransfer = mOwnerQueue && mOwnerQueue->famIndex != mQueue.famIndex;
+  auto srcFamily = ownershipTransfer ? mQueue.famIndex : VK_QUEUE_FAMILY_IGNORED;
+  auto dstFamily = ownershipTransfer ? mOwnerQueue->famIndex : VK_QUEUE_FAMILY_IGNORED;
+
+  auto postBarriers = [&](vk::AccessFlags srcAccess, vk::AccessFlags dstAccess,
+                          std::vector<vk::BufferMemoryBarrier>& bufferBarriers, std::vector<vk::ImageMemoryBarrier>& imageBarriers) {
+    if( ownershipTransfer ) {
+      for( auto& copy : mPendingBufferCopies ) {
+        bufferBarriers.emplace_back(vk::BufferMemoryBarrier()
+          .setSrcAccessMask(srcAccess)
+          .setDstAccessMask(dstAccess)
+          .setSrcQueueFamilyIndex(srcFamily)
+          .setDstQueueFamilyIndex(dstFamily)
+          .setBuffer(copy.dst)
+          .setOffset(copy.region.dstOffset)
+          .setSize(copy.region.size));
+      }
+    }
+    for( auto& copy : mPendingImageCopies ) {
+      auto& sub = copy.region.imageSubresource;
+      imageBarriers.emplace_back(vk::ImageMemoryBarrier()
+        .setSrcAccessMask(srcAccess)
+        .setDstAccessMask(dstAccess)
+        .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(copy.finalLayout)
+        .setSrcQueueFamilyIndex(srcFamily)
+        .setDstQueueFamilyIndex(dstFamily)
+        .setImage(copy.dst)
+        .setSubresourceRange(vk::ImageSubresourceRange(sub.aspectMask, sub.mipLevel, 1, sub.baseArrayLayer, sub.layerCount)));
+    }
+  };
+
+  std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+  std::vector<vk::ImageMemoryBarrier> imageBarriers;
+  if( ownershipTransfer ) {
+    // Release
+    postBarriers(vk::AccessFlagBits::eTransferWrite, {}, bufferBarriers, imageBarriers);
+    cmd.pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eBottomOfPipe,
+      {}, 0, nullptr,
+      static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+      static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+  } else {
+    // Make the writes visible to anything submitted after the batch
+    postBarriers(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead, bufferBarriers, imageBarriers);
+    auto barrier = vk::MemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eMemoryRead);
+    cmd.pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eAllCommands,
+      {}, 1, &barrier, 0, nullptr,
+      static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+  }
+  cmd.end();
+
+  batch.fence = mDeviceInstance.device().createFenceUnique({});
+  if( ownershipTransfer ) {
+    // Acquire on the owner queue, matching the release barriers
+    commandBufferAllocateInfo.setCommandPool(mAcquireCommandPool.get());
+    batch.acquireCommandBuffer = std::move(mDeviceInstance.device().allocateCommandBuffersUnique(commandBufferAllocateInfo).front());
+    auto& acquireCmd = batch.acquireCommandBuffer.get();
+    acquireCmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    bufferBarriers.clear();
+    imageBarriers.clear();
+    postBarriers({}, vk::AccessFlagBits::eMemoryRead, bufferBarriers, imageBarriers);
+    acquireCmd.pipelineBarrier(
+      vk::PipelineStageFlagBits::eTopOfPipe,
+      vk::PipelineStageFlagBits::eAllCommands,
+      {}, 0, nullptr,
+      static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+      static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    acquireCmd.end();
+
+    batch.semaphore = mDeviceInstance.device().createSemaphoreUnique({});
+    auto submitInfo = vk::SubmitInfo()
+      .setCommandBufferCount(1)
+      .setPCommandBuffers(&cmd)
+      .setSignalSemaphoreCount(1)
+      .setPSignalSemaphores(&batch.semaphore.get());
+    mQueue.queue.submit(1, &submitInfo, {});
+
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+    auto acquireInfo = vk::SubmitInfo()
+      .setWaitSemaphoreCount(1)
+      .setPWaitSemaphores(&batch.semaphore.get())
+      .setPWaitDstStageMask(&waitStage)
+      .setCommandBufferCount(1)
+      .setPCommandBuffers(&acquireCmd);
+    mOwnerQueue->queue.submit(1, &acquireInfo, batch.fence.get());
+  } else {
+    auto submitInfo = vk::SubmitInfo()
+      .setCommandBufferCount(1)
+      .setPCommandBuffers(&cmd);
+    mQueue.queue.submit(1, &submitInfo, batch.fence.get());
+  }
+
+  batch.ringEnd = mRingHead;
+  batch.dedicatedStaging = std::move(mPendingDedicatedStaging);
+  mPendingDedicatedStaging.clear();
+  mPendingBufferCopies.clear();
+  mPendingImageCopies.clear();
+  mPendingCount = 0;
+
+  mInFlight.emplace_back(std::move(batch));
+  return mInFlight.back().serial;
+}
+
+void UploadBatcher::recordBufferCopies(vk::CommandBuffer& cmd) {
+  // Consecutive copies between the same buffers are merged into one command. Regions of
+  // a command must not overlap, and separate commands aren't ordered, so if a copy overlaps
+  // anything written since the last barrier the writes are separated by another barrier
+  std::vector<vk::BufferCopy> run;
+  vk::Buffer runSrc;
+  vk::Buffer runDst;
+  auto recordRun = [&]() {
+    if( run.empty() ) return;
+    cmd.copyBuffer(runSrc, runDst, static_cast<uint32_t>(run.size()), run.data());
+    run.clear();
+  };
+
+  // Destination ranges written since the last barrier
+  std::map<VkBuffer, std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>>> written;
+  for( auto& copy : mPendingBufferCopies ) {
+    auto begin = copy.region.dstOffset;
+    auto end = begin + copy.region.size;
+    auto& ranges = written[static_cast<VkBuffer>(copy.dst)];
+    auto overlaps = std::any_of(ranges.begin(), ranges.end(), [&](auto& r) {
+      return begin < r.second && r.first < end;
+    });
+    if( overlaps ) {
+      recordRun();
+      auto barrier = vk::MemoryBarrier()
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+      cmd.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eTransfer,
+        {}, 1, &barrier, 0, nullptr, 0, nullptr);
+      written.clear();
+    }
+
+    if( !run.empty() && (copy.src != runSrc || copy.dst != runDst) ) recordRun();
+    runSrc = copy.src;
+    runDst = copy.dst;
+    run.emplace_back(copy.region);
+    written[static_cast<VkBuffer>(copy.dst)].emplace_back(begin, end);
+  }
+  recordRun();
+}
+
+void UploadBatcher::retire(uint64_t waitSerial) {
+  while( !mInFlight.empty() ) {
+    auto& batch = mInFlight.front();
+    if( batch.serial <= waitSerial ) {
+      mDeviceInstance.device().waitForFences(1, &batch.fence.get(), true, std::numeric_limits<uint64_t>::max());
+    } else if( mDeviceInstance.device().getFenceStatus(batch.fence.get()) != vk::Result::eSuccess ) {
+      break;
+    }
+    mCompletedSerial = batch.serial;
+    mRingTail = batch.ringEnd;
+    mInFlight.pop_front();
+  }
+}
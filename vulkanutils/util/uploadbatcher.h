@@ -0,0 +1,143 @@
+/*
+ * Provided under the BSD 3-Clause License, see LICENSE.
+ *
+ * Copyright (c) 2020, Gareth Francis
+ * All rights reserved.
+ */
+
+#ifndef UPLOADBATCHER_H
+#define UPLOADBATCHER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include "deviceinstance.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class SimpleBuffer;
+
+/**
+ * Batched uploads to device memory
+ * - Data is copied into a large staging ring when enqueued
+ * - All pending copies are recorded into a single command buffer on submit
+ * - Each submission gets a serial, which can be polled/waited on
+ *
+ * Staging space is reclaimed as submissions complete. If the ring is full
+ * the pending batch is submitted and the call blocks until space is available.
+ * Uploads larger than the ring get a dedicated staging buffer.
+ *
+ * Copies may be performed on a different queue family to where the data
+ * is used (A dedicated transfer queue). In that case written ranges are
+ * released by the upload queue and acquired on the owner queue.
+ */
+class UploadBatcher
+{
+public:
+  /**
+   * @param queue The queue to perform copies on
+   * @param ownerQueue The queue which will use the uploaded data, if from a different
+   *                   family queue ownership is transferred as part of each submission
+   */
+  UploadBatcher(DeviceInstance& deviceInstance, DeviceInstance::QueueRef& queue,
+                DeviceInstance::QueueRef* ownerQueue = nullptr, vk::DeviceSize stagingSize = 64 * 1024 * 1024);
+  ~UploadBatcher();
+
+  /// Queue a write to a buffer, data is copied immediately and may be released by the caller
+  void enqueueBuffer(vk::Buffer dst, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size);
+  void enqueueBuffer(SimpleBuffer& dst, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset = 0);
+
+  /**
+   * Queue a write to an image
+   * Previous contents of the subresource are discarded, the image
+   * will be in finalLayout once the submission completes
+   */
+  void enqueueImage(vk::Image dst, vk::ImageSubresourceLayers subresource, vk::Extent3D extent,
+                    const void* data, vk::DeviceSize size, vk::ImageLayout finalLayout);
+
+  /**
+   * Submit all pending uploads
+   * @return The serial of the submission, or of the last submission if nothing was pending
+   */
+  uint64_t submit();
+
+  /// @return true if the submission with serial (and all before it) have completed
+  bool isComplete(uint64_t serial);
+  /// Block until a submission has completed
+  void wait(uint64_t serial);
+  /// Submit anything pending, and wait for all uploads to complete
+  void waitIdle();
+
+  /// The number of uploads waiting for submit
+  uint32_t pendingCount() const { return mPendingCount; }
+  /// The number of submissions made
+  uint64_t submissionCount() const { return mNextSerial - 1; }
+
+private:
+  UploadBatcher() = delete;
+
+  struct BufferCopy {
+    vk::Buffer src;
+    vk::Buffer dst;
+    vk::BufferCopy region;
+  };
+
+  struct ImageCopy {
+    vk::Buffer src;
+    vk::Image dst;
+    vk::BufferImageCopy region;
+    vk::ImageLayout finalLayout;
+  };
+
+  struct Batch {
+    uint64_t serial = 0;
+    vk::UniqueCommandBuffer commandBuffer;
+    // Only used with an ownership transfer, submitted to the owner queue
+    vk::UniqueCommandBuffer acquireCommandBuffer;
+    vk::UniqueSemaphore semaphore;
+    vk::UniqueFence fence;
+    // Ring position at the end of the batch, space before this is released on completion
+    uint64_t ringEnd = 0;
+    std::vector<std::unique_ptr<SimpleBuffer>> dedicatedStaging;
+  };
+
+  /// Allocate space in the ring, submits/waits if the ring is full. Must hold mMutex
+  vk::DeviceSize allocateStaging(vk::DeviceSize size, vk::DeviceSize alignment);
+  /// Copy data into staging, @return the source buffer and offset. Must hold mMutex
+  std::pair<vk::Buffer, vk::DeviceSize> stage(const void* data, vk::DeviceSize size, vk::DeviceSize alignment);
+  uint64_t submitLocked();
+  /// Record the pending buffer copies in the order they were enqueued
+  void recordBufferCopies(vk::CommandBuffer& cmd);
+  /// Release any completed batches, optionally blocking until serial has completed. Must hold mMutex
+  void retire(uint64_t waitSerial = 0);
+
+  DeviceInstance& mDeviceInstance;
+  DeviceInstance::QueueRef& mQueue;
+  DeviceInstance::QueueRef* mOwnerQueue = nullptr;
+
+  vk::UniqueCommandPool mCommandPool;
+  vk::UniqueCommandPool mAcquireCommandPool;
+  std::unique_ptr<SimpleBuffer> mStaging;
+  uint8_t* mStagingData = nullptr;
+  vk::DeviceSize mStagingSize = 0;
+
+  // Positions in the ring, increase monotonically (physical offset = pos % size)
+  uint64_t mRingHead = 0;
+  uint64_t mRingTail = 0;
+
+  // Pending copies, in the order they were enqueued so later writes to a range win
+  std::vector<BufferCopy> mPendingBufferCopies;
+  std::vector<ImageCopy> mPendingImageCopies;
+  std::vector<std::unique_ptr<SimpleBuffer>> mPendingDedicatedStaging;
+  uint32_t mPendingCount = 0;
+
+  std::deque<Batch> mInFlight;
+  uint64_t mNextSerial = 1;
+  uint64_t mCompletedSerial = 0;
+
+  std::mutex mMutex;
+};
+
+#endif
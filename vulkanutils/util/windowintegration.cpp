@@ -28,12 +28,23 @@ WindowIntegration::WindowIntegration(GLFWwindow* window, DeviceInstance& deviceI
 }
 #endif
 
+WindowIntegration::WindowIntegration(DeviceInstance& deviceInstance, DeviceInstance::QueueRef& queue, vk::SampleCountFlagBits desiredSamples, vk::Extent2D extent, uint32_t numImages)
+  : WindowIntegration(deviceInstance, queue, desiredSamples) {
+  mHeadless = true;
+  mSwapChainExtent = extent;
+  createOffscreenImages(numImages);
+  createSwapChainImageViews();
+  createDepthResources();
+  createMultiSampleResources();
+}
+
 WindowIntegration::~WindowIntegration() {
   for(auto& p : mSwapChainImageViews) p.reset();
   mMultiSampleImage.reset();
   mDepthImage.reset();
   mSwapChain.reset();
-  vkDestroySurfaceKHR(mDeviceInstance.instance(), mSurface, nullptr);
+  mOffscreenImages.clear();
+  if( mSurface ) vkDestroySurfaceKHR(mDeviceInstance.instance(), mSurface, nullptr);
 }
 
 #ifdef USE_GLFW
@@ -48,7 +59,7 @@ void WindowIntegration::createSurfaceGLFW(GLFWwindow* window) {
 #endif
 
 
-void WindowIntegration::createSwapChain(DeviceInstance::QueueRef& queue) {
+vk::UniqueSwapchainKHR WindowIntegration::createSwapChain(DeviceInstance::QueueRef& queue) {
   if( !mDeviceInstance.physicalDevice().getSurfaceSupportKHR(queue.famIndex, mSurface) ) throw std::runtime_error("createSwapChainXlib: Physical device doesn't support surfaces");
 
   // Parameters used in swapchain must comply with limits of the surface
@@ -85,11 +96,57 @@ void WindowIntegration::createSwapChain(DeviceInstance::QueueRef& queue) {
       .setCompositeAlpha(alphaMode)
       .setPresentMode(mSwapPresentMode)
       .setClipped(true)
-      .setOldSwapchain({})
+      .setOldSwapchain(mSwapChain ? mSwapChain.get() : vk::SwapchainKHR()) // If recreating, lets the implementation reuse the old swapchain's resources
       ;
 
+  // Any previous swapchain is retired by the creation, but may still be presenting
+  auto oldSwapChain = std::move(mSwapChain);
   mSwapChain = mDeviceInstance.device().createSwapchainKHRUnique(info);
   mSwapChainImages = mDeviceInstance.device().getSwapchainImagesKHR(mSwapChain.get());
+  return oldSwapChain;
+}
+
+vk::UniqueSwapchainKHR WindowIntegration::recreateSwapChain(DeviceInstance::QueueRef& queue) {
+  if( mHeadless ) throw std::runtime_error("WindowIntegration::recreateSwapChain: Offscreen targets can't be recreated");
+
+  // Views/attachments are sized for the old swapchain
+  mSwapChainImageViews.clear();
+  mMultiSampleImage.reset();
+  mDepthImage.reset();
+
+  auto oldSwapChain = createSwapChain(queue);
+  createSwapChainImageViews();
+  createDepthResources();
+  createMultiSampleResources();
+  return oldSwapChain;
+}
+
+void WindowIntegration::createOffscreenImages(uint32_t numImages) {
+  if( numImages == 0 ) throw std::runtime_error("createOffscreenImages: numImages must be >= 1");
+
+  // 8-bit srgb is guaranteed to be usable as a colour attachment, and matches
+  // what we'd usually get from a window system
+  mSwapChainFormat = vk::SurfaceFormatKHR(vk::Format::eR8G8B8A8Srgb, vk::ColorSpaceKHR::eSrgbNonlinear);
+
+  // Colour targets, equivalent of the swapchain images
+  // TransferSrc so the results can be read back if needed
+  for( auto i = 0u; i < numImages; ++i ) {
+    std::unique_ptr<SimpleImage> img(new SimpleImage(
+                                       mDeviceInstance,
+                                       vk::ImageType::e2D,
+                                       vk::ImageViewType::e2D,
+                                       mSwapChainFormat.format,
+                                       {mSwapChainExtent.width, mSwapChainExtent.height, 1},
+                                       1, 1,
+                                       vk::SampleCountFlagBits::e1,
+                                       vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+                                       vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                       vk::ImageAspectFlagBits::eColor
+                                       ));
+    img->name() = "Offscreen colour target " + std::to_string(i);
+    mSwapChainImages.emplace_back(img->image());
+    mOffscreenImages.emplace_back(std::move(img));
+  }
 }
 
 void WindowIntegration::createDepthResources() {
@@ -21,6 +21,10 @@
 
 /**
  * Functionality for window system integration, swapchains and such
+ *
+ * Can also be created headless, in which case the 'swapchain' is a ring
+ * of offscreen colour targets. Nothing is presented, but the images/views/extent
+ * can be used in exactly the same way as a real swapchain.
  */
 class WindowIntegration
 {
@@ -37,6 +41,23 @@ public:
   WindowIntegration(GLFWwindow* window, DeviceInstance& deviceInstance, DeviceInstance::QueueRef& queue, vk::SampleCountFlagBits desiredSamples);
 #endif
 
+  /// Setup offscreen render targets, no window or swapchain required
+  /// @param extent Size of the render targets
+  /// @param numImages Number of colour targets in the ring, equivalent to the swapchain length
+  WindowIntegration(DeviceInstance& deviceInstance, DeviceInstance::QueueRef& queue, vk::SampleCountFlagBits desiredSamples, vk::Extent2D extent, uint32_t numImages);
+
+  /**
+   * Recreate the swapchain and attachments to match the surface, after a resize or similar
+   * The old swapchain is retired through oldSwapchain, rather than destroyed beforehand.
+   * The caller must ensure no submitted work still references the old images/views
+   * @return The retired swapchain. Presents from it may still be pending, so the caller
+   *         must keep it alive until the frames in flight at retirement have completed
+   */
+  vk::UniqueSwapchainKHR recreateSwapChain(DeviceInstance::QueueRef& queue);
+
+  /// Whether the images are offscreen targets rather than a presentable swapchain
+  bool headless() const { return mHeadless; }
+
   vk::Extent2D swapChainExtent() const { return mSwapChainExtent; }
   vk::Format swapChainFormat() const { return mSwapChainFormat.format; }
   size_t swapChainSize() const { return mSwapChainImages.size(); }
@@ -57,7 +78,9 @@ private:
   GLFWwindow* mGLFWWindow = nullptr;
 #endif
 
-  void createSwapChain(DeviceInstance::QueueRef& queue);
+  /// @return The previous swapchain, if any, retired by the creation
+  vk::UniqueSwapchainKHR createSwapChain(DeviceInstance::QueueRef& queue);
+  void createOffscreenImages(uint32_t numImages);
   void createSwapChainImageViews();
   void createDepthResources();
   void createMultiSampleResources();
@@ -93,6 +116,10 @@ private:
   vk::UniqueSwapchainKHR mSwapChain;
   std::vector<vk::UniqueImageView> mSwapChainImageViews;
 
+  // If headless these are the 'swapchain' images
+  std::vector<std::unique_ptr<SimpleImage>> mOffscreenImages;
+  bool mHeadless = false;
+
   vk::SampleCountFlagBits mSamples = vk::SampleCountFlagBits::e1;
 };
 